@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * sprite sheet animations
+ *
+ * a descriptor names one sheet and lists its clips,
+ * frames belong to the clip above them:
+ *   sheet <path>
+ *   clip <name> <loop frame> <end frame> <stop frame>
+ *   frame <x> <y> <width> <height> <ms shown>
+ * lines starting with # are comments
+ */
+
+#include "render.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+struct AnimationFrame {
+	// in sheet pixels
+	SDL_Rect source;
+	// 0 leaves the timing to whoever plays it
+	uint64_t time;
+};
+
+struct AnimationClip {
+	std::vector<AnimationFrame> frames;
+	// walking past end goes back to loop,
+	// stopping shows stop once, then frame 0
+	int loop_frame;
+	int end_frame;
+	int stop_frame;
+};
+
+class AnimationSet
+{
+	/*
+	 * every clip of a character, cut from one texture,
+	 * shared between everything that looks the same
+	 */
+
+private:
+	TextureAccess sheet;
+	std::vector<AnimationClip> clips;
+	std::vector<std::string> names;
+
+public:
+	// throws on a missing or malformed descriptor
+	AnimationSet(TextureManager *texture_manager, const std::filesystem::path &path);
+	// a single clip showing all of texture
+	AnimationSet(const TextureAccess &texture);
+
+	const TextureAccess &getSheet() const;
+	// -1 if there is no clip by that name
+	int findClip(const std::string &name) const;
+	// no bounds checks, use findClip
+	const AnimationClip &getClip(int clip) const;
+};
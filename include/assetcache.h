@@ -0,0 +1,82 @@
+#pragma once
+
+/*
+ * decoded pixels kept on disk between runs
+ *
+ * one file holds every entry, keyed by source path
+ * and checked against the source mtime and size,
+ * pixels are compressed with the codec in lz.h
+ *
+ * layout, all little endian:
+ *   char magic[4], uint32 version, uint32 entry count
+ *   per entry: uint16 length, path bytes,
+ *     int64 mtime, uint64 size, uint32 width, uint32 height,
+ *     uint32 pixel format, uint32 compressed size, compressed rows
+ */
+
+#include "mappedfile.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <filesystem>
+
+#ifdef __unix__
+#include <SDL2/SDL.h>
+#elif _WIN32
+#include <SDL.h>
+#else
+#error Unsupported platform
+#endif
+
+#define ASSET_CACHE_PATH "cache/assets.ooqc"
+#define ASSET_CACHE_VERSION 1
+
+class AssetCache
+{
+private:
+	struct ENTRY {
+		int64_t mtime;
+		uint64_t size;
+		uint32_t width;
+		uint32_t height;
+		uint32_t format;
+		// inside the mapped file, or buffer for entries from this run
+		const char *data;
+		size_t data_size;
+		std::shared_ptr<std::vector<char>> buffer;
+	};
+
+	std::filesystem::path path;
+	std::unique_ptr<MappedFile> file;
+	std::unordered_map<std::string, ENTRY> entries;
+	std::mutex mutex;
+	bool dirty;
+	unsigned long hits;
+	unsigned long misses;
+
+public:
+	AssetCache(const std::filesystem::path &path = ASSET_CACHE_PATH);
+	// writes back new entries
+	~AssetCache();
+
+	AssetCache(const AssetCache &other) = delete;
+	AssetCache &operator=(const AssetCache &other) = delete;
+
+	// thread safe, nullptr when missing or the source changed
+	SDL_Surface *load(const std::filesystem::path &source);
+	// thread safe, 32 bit surfaces only
+	void store(const std::filesystem::path &source, SDL_Surface *surface);
+	// not while loads run, entries may point into the old file
+	void save();
+
+	void getStats(unsigned long *hits, unsigned long *misses);
+
+private:
+	void parse();
+
+	static bool stat(const std::filesystem::path &source, int64_t *mtime, uint64_t *size);
+};
@@ -1,12 +1,25 @@
 #pragma once
 
 #include "utilities.h"
+#include "animation.h"
 #include "manager.h"
 #include "render.h"
+#include "mapfile.h"
+#include "grid.h"
+#include "path.h"
+#include "pool.h"
+#include "jobs.h"
 
+#include <atomic>
 #include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 #include <list>
+#include <map>
+#include <unordered_map>
 #include <filesystem>
 
 // necessary forward declarations
@@ -15,34 +28,194 @@ class GameManager;
 class ObjectWalker;
 class UIManager;
 
+// side of a cached map chunk, in tiles
+#define CHUNK_SIZE 16
+// chunks kept loaded around the view, far ones are released past this + 1
+#define STREAM_MARGIN 1
+// chunks loaded ahead of time per frame, visible ones always load
+#define STREAM_BUDGET 4
+// chunks around the spawn a background map load decodes
+#define PRELOAD_RADIUS 2
+// finished preloads kept around for later switches
+#define PRELOAD_MAX 2
+// objects per render job
+#define RENDER_GRAIN 64
+// tile layers are also kept at 1/2, 1/4... scale for zooming out
+#define LOD_LEVELS 3
+// furthest zoom out, the last level is drawn at full size there
+#define ZOOM_MIN (1.0 / (1 << (LOD_LEVELS - 1)))
+// share of the way to the wanted zoom covered every ZOOM_RATE_TIME ms,
+// whatever the tick rate
+#define ZOOM_RATE 0.1
+#define ZOOM_RATE_TIME 16
+// space kept around the camera centres, in pixels
+#define ZOOM_MARGIN (4 * TILE_SIZE)
+
 class MapManager
 {
 private:
 	GameManager *parent;
 	Renderer *renderer;
 	TextureManager *texture_manager;
+	InputHandler *input_handler;
 
 	std::vector<std::filesystem::path> maps;
 
 	int current_map;
 	int spawn_x, spawn_y;
-	std::vector<std::vector<std::vector<TextureAccess>>> tile;
-	std::vector<std::vector<bool>> collision;
+
+	/*
+	 * tile textures are loaded by the chunks that use them,
+	 * users counts the resident chunks per tile id
+	 */
+	struct TILE {
+		std::filesystem::path path;
+		PathId path_id;
+		TextureAccess texture;
+		int users;
+	};
+
+	// tile ids per layer index tile_table, id 0 is no tile
+	std::vector<TILE> tile_table;
+	Grid<uint16_t> tile[MAP_LAYERS];
+	// small enough to stay whole, objects collide off screen too
+	BitGrid collision;
+
+	/*
+	 * static tile layers are drawn once into chunk textures,
+	 * each frame only blits the visible chunks
+	 */
+	struct CHUNK {
+		// empty when the layer has no tiles in this chunk
+		TextureAccess layer[MAP_LAYERS];
+		// tile ids used in this chunk
+		std::vector<uint16_t> tiles;
+		bool dirty;
+		bool resident;
+	};
+
+	std::vector<CHUNK> chunks;
+	int chunks_x, chunks_y;
+
+	/*
+	 * a lod at level n covers 2^n by 2^n chunks at 1 / 2^n scale,
+	 * in a texture the size of one chunk, built from the level below,
+	 * so a zoomed out view draws about as many textures as a close one
+	 */
+	struct LOD {
+		TextureAccess layer[MAP_LAYERS];
+		bool dirty;
+	};
+
+	// level 0 are the chunks themselves, lods[0] stays empty
+	std::vector<LOD> lods[LOD_LEVELS];
+	int lods_x[LOD_LEVELS], lods_y[LOD_LEVELS];
+	int resident_chunks;
+	unsigned int render_resets;
+
+	/*
+	 * a map parsed and partly decoded off the game thread,
+	 * uploads still happen on the game thread when it switches
+	 */
+	struct PRELOAD {
+		int map;
+		std::thread worker;
+		// set by the worker once everything below is written
+		std::atomic<bool> ready;
+		std::unique_ptr<MapFile> data;
+		// by tile id, nullptr where not decoded
+		std::vector<SDL_Surface *> surfaces;
+		std::exception_ptr error;
+	};
+
+	std::list<PRELOAD> preloads;
+	int last_ticket;
+	int done_ticket;
+	// switch waiting on its preload, -1 for none
+	int pending_map;
+	int pending_ticket;
+	bool pending_respawn;
+
+	// what the current map was read from, for noticing edits
+	FileStamp source_stamp;
+	FileStamp compiled_stamp;
+	// objects the map places, collected or not
+	std::vector<MapData::OBJECT> placed;
+	std::map<std::filesystem::path, FileStamp> object_stamps;
 
 public:
+	// a point chunks are kept loaded around, in pixels
+	struct CAMERA {
+		int x, y;
+		// movement over the last sim step, prefetch goes this way
+		int vel_x, vel_y;
+	};
+
 	MapManager(GameManager *parent);
+	~MapManager();
 
+	// blocks until the map is in
 	void loadMap(int map, bool respawn = false);
 
+	// switches on the first frame after the map is ready, returns a ticket
+	int requestMap(int map, bool respawn = false);
+	// parses and decodes in the background, for maps likely to come next
+	void preloadMap(int map);
+	// true once the switch for ticket or a later one happened
+	bool isLoaded(int ticket);
+	int getCurrentMap();
+	// swaps in a finished request, call between frames
+	void update();
+
 	void getSpawn(int *x, int *y);
 	bool getCollision(int pos_x, int pos_y);
+	// true if anything in the footprint blocks
+	bool getCollision(int pos_x, int pos_y, int size_x, int size_y);
 
 	void getSize(int *x, int *y);
 
+	// returns the id of texture, adding it to the tile table if needed
+	uint16_t addTile(TextureAccess texture);
+	void setTile(int pos_x, int pos_y, int layer, uint16_t id);
+
+	// applies edits to the current map and its object files,
+	// textures are the images reloaded since the last call
+	void hotReload(const std::vector<std::filesystem::path> &textures);
+
+	// loads chunks near the cameras, releases far ones
+	void stream(const std::vector<CAMERA> &cameras);
+	int getResidentChunks();
+
 	void render();
 
 private:
-	void resizeMapStorage(int x, int y, bool absolute = false);
+	void applyMap(int map, MapFile &data, std::vector<SDL_Surface *> *surfaces, bool respawn);
+	// changes only what differs from the current map
+	void patchMap(MapFile &data);
+	void stampMap();
+	PRELOAD &startPreload(int map);
+	void dropPreload(std::list<PRELOAD>::iterator preload);
+
+	// both safe to call off the game thread
+	static std::unique_ptr<MapFile> openMap(const std::filesystem::path &source);
+	// surfaces come out in format, ready to upload
+	static void runPreload(PRELOAD *preload, std::filesystem::path source, AssetCache *cache, Uint32 format);
+
+	void resetChunks();
+	// ids the chunk cells hold right now, seen is all false going in and out
+	void listTiles(int chunk, std::vector<bool> *seen);
+	void buildChunk(int chunk_x, int chunk_y);
+	// the chunk and the lods above it are drawn again
+	void markChunk(int chunk_x, int chunk_y);
+	// children must be built, level 1 needs resident chunks
+	void buildLod(int level, int lod_x, int lod_y);
+	// level drawn at the renderer scale
+	int getLodLevel();
+	// loads the tile textures of all chunks in one batch
+	void loadChunks(const std::vector<int> &load);
+	void releaseChunk(int chunk);
+	void acquireTile(uint16_t id);
+	void releaseTile(uint16_t id);
 };
 
 class GameObject
@@ -56,18 +229,19 @@ protected:
 	// render stuff
 	ObjectWalker *object_walker;
 
-	std::vector<TextureAccess> up;
-	std::vector<TextureAccess> down;
-	std::vector<TextureAccess> side;
+	// nullptr draws nothing
+	std::shared_ptr<AnimationSet> animation;
+	// clip shown per direction, right is the left one flipped
+	int clips[DIR_SIZE];
 
 	int current_frame;
-	int loop_frame;
-	int end_frame;
-	int stop_frame;
 	DIR dir;
 
 	int screen_x;
 	int screen_y;
+	// screen position before the last sim step, for interpolation
+	int prev_x;
+	int prev_y;
 
 	bool camera_center;
 
@@ -79,6 +253,13 @@ protected:
 
 	bool collision;
 
+	// position in the awake list, -1 while asleep
+	int awake_index;
+	// waiting in the graveyard
+	bool unloaded;
+	// object file it was loaded from, empty for players
+	std::filesystem::path source;
+
 protected:
 	GameObject(GameManager *parent);
 
@@ -88,6 +269,10 @@ public:
 	void setScreenPos(int x, int y, bool anim = true);
 	void getScreenPos(int *x, int *y);
 	void getCenter(int *x, int *y);
+	// blend of the last two sim steps, alpha in [0, 1]
+	void getCenter(double alpha, int *x, int *y);
+	// movement over the last sim step
+	void getVelocity(int *x, int *y);
 
 	bool isCameraCenter();
 
@@ -97,7 +282,17 @@ public:
 	bool checkMapCollision(int offset_x, int offset_y);
 	bool checkObjectCollision(int offset_x, int offset_y);
 
-	void render();
+	// objects that can never move skip ticking
+	bool isAwake();
+	// blocks and never moves, paths go around it
+	bool isObstacle();
+	bool isUnloaded();
+
+	// remember the current position as the previous sim step
+	void savePrevious();
+
+	// reads only, safe to run for many objects at once
+	void render(double alpha, std::vector<RenderItem> &items);
 	virtual bool collide();
 	virtual void runTick(uint64_t delta);
 
@@ -108,8 +303,11 @@ private:
 
 	void advanceFrame(DIR dir);
 	void stopFrame(DIR dir);
+	// ms the current frame is shown, 0 if the clip does not say
+	uint64_t getFrameTime();
 
 	friend class ObjectWalker;
+	friend class GameManager;
 };
 
 class ObjectWalker
@@ -122,7 +320,7 @@ class ObjectWalker
 private:
 	// measured in ms/pixel
 	const uint64_t SPEED = 5;
-	// ms/animation frame, reccomended multiple of SPEED
+	// ms/animation frame unless the clip says, reccomended multiple of SPEED
 	const uint64_t FRAME_TIME = SPEED * 10;
 
 	GameObject *parent;
@@ -131,13 +329,30 @@ private:
 	uint64_t movement_deadline;
 	uint64_t animation_deadline;
 
+	// map cells still to walk, one step apart
+	std::vector<WAYPOINT> path;
+	size_t path_next;
+
 public:
 	ObjectWalker(GameObject *parent);
 
+	GameObject *getParent();
+
 	void setDestination(int x, int y);
 	//void cancel();
+	// parent stands on its destination
+	bool isArrived();
+
+	// walked tile by tile, stops at the first blocked step
+	void setPath(std::vector<WAYPOINT> path);
+	void clearPath();
+	bool hasPath();
 
+	// moves as many pixels as delta allows
 	void runTick(uint64_t delta);
+
+private:
+	void followPath();
 };
 
 class Player : public GameObject
@@ -149,6 +364,9 @@ public:
 	Player(GameManager *parent, int type);
 	~Player() = default;
 
+	// to the map spawn, the second player beside the first
+	void spawn();
+
 	void runTick(uint64_t delta);
 };
 
@@ -217,9 +435,29 @@ private:
 	Renderer *renderer;
 	MapManager map_manager;
 	QuizManager quiz_manager;
+	PathFinder path_finder;
+
+	// one pool per type, iterated type by type
+	Pool<Player> players;
+	Pool<StaticObject> statics;
+	Pool<PickupObject> pickups;
+	Player *player;
+	// nullptr unless playing with two
+	Player *second_player;
+
+	// eased towards what fits every camera centre, per sim step
+	double zoom;
+	double prev_zoom;
+
+	/*
+	 * only awake objects tick, the rest sleep,
+	 * unloaded objects wait in the graveyard until
+	 * nothing can be running on them anymore
+	 */
+	std::vector<GameObject *> awake;
+	std::vector<GameObject *> graveyard;
 
-	std::list<GameObject *> objects;
-	std::vector<std::vector<GameObject *>> collision;
+	Grid<GameObject *> collision;
 
 	uint64_t playtime;
 
@@ -228,6 +466,15 @@ private:
 	int collectibles;
 	int collected;
 	std::list<std::string> hints;
+	unsigned int hint_version;
+
+	// object items are built by jobs, one list per range
+	JobSystem::Group render_jobs;
+	std::vector<GameObject *> render_objects;
+	std::vector<std::vector<RenderItem>> render_items;
+
+	// by descriptor path, objects that look the same share one
+	std::unordered_map<std::filesystem::path::string_type, std::shared_ptr<AnimationSet>> animations;
 
 public:
 	GameManager(Manager *parent);
@@ -237,12 +484,26 @@ public:
 	Renderer *getRenderer();
 	MapManager *getMapManager();
 	QuizManager *getQuizManager();
-	Player *getPlayer();
+	PathFinder *getPathFinder();
+	// nullptr for a second player in a single player game
+	Player *getPlayer(int type = 0);
 
+	// loaded once, throws on a bad descriptor
+	std::shared_ptr<AnimationSet> loadAnimation(const std::filesystem::path &path);
 	void loadObject(std::filesystem::path object_path, int map_x, int map_y);
+	// safe on the calling object, freed at the end of the tick
 	void unloadObject(GameObject *object);
-
+	// the object loaded from source at that position, false if none is left
+	bool unloadMapObject(const std::filesystem::path &source, int map_x, int map_y);
+	// everything but the players, for map changes
+	void clearObjects();
+	void wakeObject(GameObject *object);
+	void sleepObject(GameObject *object);
+
+	// reallocates only when the map size changed
 	void updateCollision();
+	void addCollision(GameObject *object);
+	void removeCollision(GameObject *object);
 	GameObject *getCollision(int pos_x, int pos_y);
 
 	uint64_t getPlaytime();
@@ -257,6 +518,34 @@ public:
 	void useCollectible();
 	void addHint(std::string hint);
 	std::list<std::string> getHints();
+	// bumped on every change to the hints
+	unsigned int getHintVersion();
 
+	// one fixed simulation step
 	void runTick(uint64_t delta);
+	// draws the world alpha of the way to the next step
+	void render(double alpha);
+	// render in two halves, anything but texture changes may run between
+	void beginRender(double alpha);
+	void endRender();
+
+private:
+	void addObject(GameObject *object);
+	void flushGraveyard();
+	// zooms out until every player fits, delta in ms
+	void updateZoom(uint64_t delta);
+
+	// players first, skips unloaded objects
+	template <typename F>
+	void forEachObject(F function)
+	{
+		auto live = [&](GameObject *object) {
+			if (not object->isUnloaded())
+				function(object);
+		};
+
+		players.forEach(live);
+		statics.forEach(live);
+		pickups.forEach(live);
+	}
 };
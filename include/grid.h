@@ -0,0 +1,102 @@
+#pragma once
+
+/*
+ * flat 2d storage, row by row
+ * cell (x, y) lives at y * width + x
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+template <typename T>
+class Grid
+{
+private:
+	int width;
+	int height;
+	std::vector<T> cells;
+
+public:
+	Grid(int width = 0, int height = 0, T value = T()) :
+		width(width),
+		height(height),
+		cells(static_cast<size_t>(width) * height, value)
+	{}
+
+	// drops old contents
+	void resize(int width, int height, T value = T())
+	{
+		this->width = width;
+		this->height = height;
+		cells.assign(static_cast<size_t>(width) * height, value);
+	}
+
+	int getWidth() const
+	{
+		return width;
+	}
+
+	int getHeight() const
+	{
+		return height;
+	}
+
+	bool contains(int x, int y) const
+	{
+		return x >= 0 and y >= 0 and x < width and y < height;
+	}
+
+	// no bounds checks, use contains
+	T &operator()(int x, int y)
+	{
+		return cells[static_cast<size_t>(y) * width + x];
+	}
+
+	const T &operator()(int x, int y) const
+	{
+		return cells[static_cast<size_t>(y) * width + x];
+	}
+
+	T *getRow(int y)
+	{
+		return cells.data() + static_cast<size_t>(y) * width;
+	}
+};
+
+class BitGrid
+{
+	/*
+	 * one bit per cell, every row starts on a new word
+	 * so a footprint query reads one or two words per row
+	 */
+
+private:
+	int width;
+	int height;
+	size_t stride;
+	std::vector<uint64_t> words;
+
+public:
+	BitGrid(int width = 0, int height = 0, bool value = false);
+
+	// drops old contents
+	void resize(int width, int height, bool value = false);
+
+	int getWidth() const;
+	int getHeight() const;
+	// words per row
+	size_t getStride() const;
+
+	bool get(int x, int y) const;
+	void set(int x, int y, bool value);
+
+	// true if any cell in the area is set, or lies outside when outside is set
+	bool any(int x, int y, int size_x, int size_y, bool outside = true) const;
+
+	uint64_t *getRow(int y);
+};
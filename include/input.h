@@ -1,27 +1,130 @@
 #pragma once
 
+/*
+ * keys are bound to actions per player and kept as bitmasks
+ *
+ * held:     down right now
+ * pressed:  went down during the last processEvents
+ * released: went up during the last processEvents
+ * latched:  went down and was not consumed yet, so taps
+ *           between two reads of a game tick are not lost
+ *
+ * every bound key event also goes into a ring buffer
+ * with its timestamp, readers keep their own cursor
+ */
+
 #include "utilities.h"
 
-#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <filesystem>
+
+#define INPUT_PLAYERS 2
+// events kept for readers that fall behind
+#define INPUT_QUEUE 64
+// us of game time per recorded frame, what OOQ_bench replays at
+#define REPLAY_FRAME_TIME 16667
+
+// the first four line up with DIR
+enum ACTION {
+	ACTION_UP = UP,
+	ACTION_LEFT = LEFT,
+	ACTION_DOWN = DOWN,
+	ACTION_RIGHT = RIGHT,
+	ACTION_PAUSE,
+	ACTION_ENTER,
+	ACTION_DEBUG,
+	ACTION_ANSWER_1,
+	ACTION_ANSWER_2,
+	ACTION_ANSWER_3,
+	ACTION_SIZE
+};
+
+struct INPUT_EVENT {
+	// SDL ms
+	uint32_t timestamp;
+	// SDL_Keycode that caused it
+	int32_t key;
+	int player;
+	ACTION action;
+	bool down;
+};
 
 class InputHandler
 {
 private:
+	struct PLAYER {
+		uint32_t held;
+		uint32_t pressed;
+		uint32_t released;
+		uint32_t latched;
+	};
+
 	bool quit;
-	std::vector<bool> player;
-	std::vector<bool> player2;
-	bool pause;
-	bool enter;
-	std::vector<bool> answer;
+	unsigned int render_resets;
+	// picks which keys go to which player
+	int player_count;
+	PLAYER players[INPUT_PLAYERS];
+	// one bit per entry of the binding table, two keys may hold the same action
+	uint64_t bindings_down;
+
+	// left click in logical coords, kept until consumed
+	bool click;
+	int click_x, click_y;
+
+	INPUT_EVENT queue[INPUT_QUEUE];
+	// events ever queued, the next one goes to queue_end % INPUT_QUEUE
+	uint64_t queue_end;
 
 public:
 	InputHandler();
 
+	// edges are per call, the previous ones are dropped
 	void processEvents();
 	bool isQuit(bool clear = false);
-	bool isPlayer(DIR dir, bool clear = false);
-	bool isPlayer2(DIR dir, bool clear = false);
-	bool isPause(bool clear = false);
-	bool isEnter(bool clear = false);
-	bool isAnswer(int ans, bool clear = false);
+	// 1 or 2, the arrows go to player 2 when there are two
+	void setPlayers(int count);
+
+	bool isHeld(ACTION action, int player = 0);
+	bool isPressed(ACTION action, int player = 0);
+	bool isReleased(ACTION action, int player = 0);
+	// held or pressed since the last consume, for game ticks
+	bool consume(ACTION action, int player = 0);
+	// the last left click since the previous call
+	bool consumeClick(int *x, int *y);
+
+	// next event after cursor, false once caught up
+	// readers more than INPUT_QUEUE behind skip to the oldest kept
+	bool readEvent(uint64_t *cursor, INPUT_EVENT *event);
+	uint64_t getEventCount();
+
+	// bumped whenever render target contents were lost
+	unsigned int getRenderResets();
+
+private:
+	void setBinding(size_t binding, bool down, uint32_t timestamp);
+	void releaseAll(uint32_t timestamp);
+};
+
+class InputRecorder
+{
+	/*
+	 * writes the key events of a session
+	 * as a script OOQ_bench can replay
+	 */
+
+private:
+	std::ofstream file;
+	uint64_t cursor;
+	uint64_t frame;
+
+public:
+	InputRecorder();
+	// adds the end line
+	~InputRecorder();
+
+	void open(const std::filesystem::path &path, int map);
+	bool isOpen();
+	// call after processEvents, time is us of game time so far
+	void record(InputHandler *input, uint64_t time);
 };
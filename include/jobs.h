@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+ * small work stealing job system
+ *
+ * every worker owns a queue, takes its newest job first
+ * and steals the oldest from the others when it runs dry.
+ * threads that are not workers share queue 0 and help
+ * out while they wait on a group. jobs must not call SDL
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem
+{
+public:
+	class Group
+	{
+		/*
+		 * jobs to wait on together,
+		 * must outlive them
+		 */
+
+	private:
+		std::atomic<size_t> pending;
+		std::exception_ptr error;
+
+		friend class JobSystem;
+
+	public:
+		Group();
+
+		Group(const Group &other) = delete;
+		Group &operator=(const Group &other) = delete;
+
+		bool isDone();
+	};
+
+private:
+	struct JOB {
+		std::function<void()> function;
+		Group *group;
+	};
+
+	struct QUEUE {
+		std::mutex mutex;
+		std::deque<JOB> jobs;
+	};
+
+	std::vector<std::unique_ptr<QUEUE>> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic<size_t> queued;
+	std::atomic<bool> stop;
+	std::mutex error_mutex;
+
+public:
+	// one worker per core but the calling one when workers < 0
+	JobSystem(int workers = -1);
+	~JobSystem();
+
+	JobSystem(const JobSystem &other) = delete;
+	JobSystem &operator=(const JobSystem &other) = delete;
+
+	int getWorkerCount();
+
+	void submit(Group &group, std::function<void()> function);
+	// runs queued jobs meanwhile, rethrows the first error of the group
+	void wait(Group &group);
+
+	// function(begin, end) over [0, count) in ranges of grain, inline if only one
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &function);
+
+private:
+	void work(size_t index);
+	bool runOne(size_t index);
+	void run(JOB &job);
+};
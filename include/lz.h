@@ -0,0 +1,16 @@
+#pragma once
+
+/*
+ * small LZ77 codec in the spirit of LZ4, for the asset cache
+ *
+ * a block is a run of sequences: token byte, literal length,
+ * literals, 16 bit offset, match length. each length nibble of 15
+ * continues in following bytes of 255 until a smaller one
+ */
+
+#include <cstddef>
+#include <vector>
+
+std::vector<char> lzCompress(const char *data, size_t size);
+// false if the block is corrupt or does not decode to exactly size bytes
+bool lzDecompress(const char *data, size_t size, char *output, size_t output_size);
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "render.h"
+#include "pacer.h"
+#include "profiler.h"
 #include "input.h"
+#include "jobs.h"
 #include "game.h"
 #include "ui.h"
 
@@ -18,10 +21,33 @@ private:
 	GameManager *game_manager;
 	UIManager *ui_manager;
 
+	FramePacer pacer;
+	Profiler profiler;
+	std::unique_ptr<JobSystem> jobs;
+	// present the last frame while this one is built, one frame more latency
+	bool pipeline;
+	bool two_players;
+	// poll data files and apply edits while running
+	bool watch;
+	uint64_t last_watch;
+	InputRecorder recorder;
+	unsigned long text_created;
+	unsigned long texture_evictions;
+	unsigned long texture_restores;
 	uint64_t last_tick = 0;
 	uint64_t current_tick = 0;
 	bool is_quit;
 
+	/*
+	 * the game runs in fixed steps of 1000 / tick_rate ms,
+	 * frames render between the last two steps
+	 */
+	int tick_rate;
+	uint64_t sim_ticks;
+	// ms simulated and us passed, sim_time <= real_time / 1000
+	uint64_t sim_time;
+	uint64_t real_time;
+
 public:
 	Manager(int argc, char **argv);
 	~Manager();
@@ -32,6 +58,15 @@ public:
 	UIManager *getUIManager();
 
 	void quit();
+	bool isQuit();
+	bool isTwoPlayers();
+
+	int getTickRate();
+	FramePacer *getPacer();
+	Profiler *getProfiler();
+	JobSystem *getJobs();
 
+	// one frame with delta us of game time, no pacing
+	void runFrame(uint64_t delta);
 	int operator()();
 };
@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+ * compiled map format
+ *
+ * text maps in data/map are the source,
+ * ooq-mapc turns them into .ooqm files that load
+ * without parsing every tile
+ *
+ * layout, all little endian:
+ *   MapHeader
+ *   tile table, per id: uint16 length, path bytes
+ *   tile grid, uint16 ids per layer, row by row, 0 = no tile
+ *   collision, one bit per cell, each row padded to 64 bits
+ *   objects, per object: int32 x, int32 y, uint16 length, path bytes
+ */
+
+#include "vfs.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+
+#define MAP_LAYERS 2
+#define MAP_VERSION 1
+#define MAP_EXTENSION ".ooqm"
+
+struct MapHeader {
+	char magic[4];
+	uint32_t version;
+	int32_t spawn_x;
+	int32_t spawn_y;
+	uint32_t width;
+	uint32_t height;
+	uint32_t layers;
+	uint32_t tile_count;
+	uint32_t object_count;
+	uint32_t tile_offset;
+	uint32_t grid_offset;
+	uint32_t collision_offset;
+	uint32_t object_offset;
+	uint32_t size;
+};
+
+struct MapData {
+	/*
+	 * a map fully decoded in memory,
+	 * what the converter works with
+	 */
+
+	struct OBJECT {
+		int pos_x, pos_y;
+		std::filesystem::path path;
+	};
+
+	int spawn_x = 0;
+	int spawn_y = 0;
+	int width = 0;
+	int height = 0;
+
+	// tile id n is tiles[n - 1]
+	std::vector<std::filesystem::path> tiles;
+	// MAP_LAYERS grids of width * height
+	std::vector<uint16_t> grid;
+	std::vector<bool> collision;
+	std::vector<OBJECT> objects;
+};
+
+class MapFile
+{
+public:
+	struct OBJECT {
+		int pos_x, pos_y;
+		std::string_view path;
+	};
+
+private:
+	FileSystem::View file;
+	std::vector<char> buffer;
+
+	const char *data;
+	const MapHeader *header;
+	const uint16_t *grid;
+	const uint64_t *collision;
+	size_t stride;
+
+	std::vector<std::string_view> tiles;
+	std::vector<OBJECT> objects;
+
+public:
+	// map a compiled file, loose or in the archive
+	MapFile(const std::filesystem::path &path);
+	// compile in memory, for maps without a compiled file
+	MapFile(const MapData &map);
+
+	void getSpawn(int *x, int *y);
+	void getSize(int *x, int *y);
+
+	// tile id 0 is empty, id n is getTiles()[n - 1]
+	const std::vector<std::string_view> &getTiles();
+	const uint16_t *getRow(int layer, int y);
+	const uint64_t *getCollisionRow(int y);
+	bool getCollision(int x, int y);
+
+	const std::vector<OBJECT> &getObjects();
+
+private:
+	void parse(size_t size);
+};
+
+std::vector<std::filesystem::path> readMapList(const std::filesystem::path &path);
+MapData readMapText(const std::filesystem::path &path);
+std::vector<char> compileMap(const MapData &map);
+void writeMapFile(const std::filesystem::path &path, const MapData &map);
@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * read only view of a whole file
+ * backed by mmap or MapViewOfFile
+ */
+
+#include <cstddef>
+#include <filesystem>
+
+class MappedFile
+{
+private:
+	const char *data;
+	size_t size;
+
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#else
+	int file;
+#endif
+
+public:
+	MappedFile(const std::filesystem::path &path);
+	~MappedFile();
+
+	MappedFile(const MappedFile &other) = delete;
+	MappedFile &operator=(const MappedFile &other) = delete;
+
+	const char *getData();
+	size_t getSize();
+};
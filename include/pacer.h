@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+ * frame timing on the performance counter
+ *
+ * vsync:    present blocks, the pacer only measures
+ * cap:      sleeps most of the frame, spins the last bit
+ * uncapped: runs as fast as it can, for benchmarks
+ */
+
+#include <cstdint>
+
+enum PACE_MODE {PACE_VSYNC = 0, PACE_CAP, PACE_UNCAPPED};
+
+class FramePacer
+{
+private:
+	PACE_MODE mode;
+	int fps;
+
+	uint64_t frequency;
+	uint64_t start;
+	// counter value the current frame should end at
+	uint64_t deadline;
+
+public:
+	FramePacer(PACE_MODE mode = PACE_VSYNC, int fps = 60);
+
+	PACE_MODE getMode();
+	int getFps();
+	bool isVsync();
+
+	// ms since the pacer was made, 64 bit
+	uint64_t getTicks();
+	// us since the pacer was made
+	uint64_t getMicros();
+
+	// call once per frame after present
+	void wait();
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+/*
+ * tile pathfinding for anything with an ObjectWalker
+ *
+ * the navigation grid is the map collision plus objects
+ * that block and never move, moving ones are left to the
+ * per step collision checks. searches are A* over 4
+ * neighbours, found paths are cached and a path is reused
+ * from any cell on it towards the same goal. a change to
+ * the grid drops the cached paths crossing its region
+ */
+
+#include "grid.h"
+
+#include <cstdint>
+#include <vector>
+
+// side of a cache invalidation region, in tiles
+#define PATH_REGION 16
+// paths kept for reuse
+#define PATH_CACHE 64
+// queued queries answered per tick, the rest wait
+#define PATH_BUDGET 16
+// cells a single search may expand before giving up
+#define PATH_MAX_NODES 16384
+
+class GameManager;
+class ObjectWalker;
+
+struct WAYPOINT {
+	int x, y;
+};
+
+class PathFinder
+{
+private:
+	// search state per cell, valid when visit matches
+	struct NODE {
+		uint32_t visit;
+		uint32_t cost;
+		int32_t from;
+	};
+
+	struct OPEN {
+		uint32_t estimate;
+		uint32_t cost;
+		int32_t cell;
+	};
+
+	struct ENTRY {
+		int goal_x, goal_y;
+		int size_x, size_y;
+		// start to goal, both included
+		std::vector<WAYPOINT> path;
+		// sorted ids of the regions the footprint crosses
+		std::vector<uint32_t> regions;
+		uint64_t used;
+	};
+
+	struct QUERY {
+		ObjectWalker *walker;
+		int goal_x, goal_y;
+	};
+
+	struct RECT {
+		int x, y, w, h;
+	};
+
+	GameManager *parent;
+
+	BitGrid nav;
+	bool stale;
+	std::vector<RECT> dirty;
+
+	// reused by every search, never shrinks
+	std::vector<NODE> nodes;
+	std::vector<OPEN> open;
+	uint32_t visit;
+
+	std::vector<ENTRY> cache;
+	uint64_t use_count;
+
+	std::vector<QUERY> queries;
+
+	unsigned long searches;
+	unsigned long cache_hits;
+
+public:
+	PathFinder(GameManager *parent);
+
+	// map changed, everything is rebuilt before the next search
+	void reset();
+	// cells whose blocking may have changed
+	void invalidate(int x, int y, int size_x, int size_y);
+
+	// begins at the start cell, false and empty when there is no way
+	bool findPath(int start_x, int start_y, int goal_x, int goal_y, int size_x, int size_y, std::vector<WAYPOINT> *path);
+
+	// replaces an earlier query of the same walker
+	void request(ObjectWalker *walker, int goal_x, int goal_y);
+	void cancel(ObjectWalker *walker);
+	// answers up to PATH_BUDGET queries, the walkers get the paths
+	void runBatch();
+
+	void getStats(unsigned long *searches, unsigned long *cache_hits);
+
+private:
+	void sync();
+	bool isBlocked(int x, int y);
+	bool findCached(int start_x, int start_y, int goal_x, int goal_y, int size_x, int size_y, std::vector<WAYPOINT> *path);
+	bool search(int start_x, int start_y, int goal_x, int goal_y, int size_x, int size_y, std::vector<WAYPOINT> *path);
+	void store(int goal_x, int goal_y, int size_x, int size_y, const std::vector<WAYPOINT> &path);
+	uint32_t getRegion(int x, int y);
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+ * typed object pool
+ *
+ * objects live in fixed blocks, so pointers stay valid
+ * and one type iterates in memory order, freed slots
+ * are reused before a new block is allocated
+ */
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+template <typename T, size_t BLOCK_SIZE = 64>
+class Pool
+{
+private:
+	struct SLOT {
+		// first member, so an object address is its slot address
+		alignas(T) unsigned char storage[sizeof(T)];
+		bool alive;
+	};
+
+	std::vector<std::unique_ptr<SLOT[]>> blocks;
+	std::vector<SLOT *> free_slots;
+	size_t count;
+
+public:
+	Pool() :
+		count(0)
+	{}
+
+	~Pool()
+	{
+		clear();
+	}
+
+	Pool(const Pool &other) = delete;
+	Pool &operator=(const Pool &other) = delete;
+
+	template <typename... ARGS>
+	T *create(ARGS &&... args)
+	{
+		if (free_slots.empty())
+			grow();
+
+		SLOT *slot = free_slots.back();
+
+		// slot stays free if the constructor throws
+		T *object = new (slot->storage) T(std::forward<ARGS>(args)...);
+
+		free_slots.pop_back();
+		slot->alive = true;
+		++count;
+
+		return object;
+	}
+
+	void destroy(T *object)
+	{
+		SLOT *slot = reinterpret_cast<SLOT *>(object);
+
+		object->~T();
+		slot->alive = false;
+		free_slots.push_back(slot);
+		--count;
+	}
+
+	void clear()
+	{
+		forEach([this](T *object) {
+			destroy(object);
+		});
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	// in memory order, objects created meanwhile may be skipped
+	template <typename F>
+	void forEach(F function)
+	{
+		for (size_t i = 0; i < blocks.size(); ++i)
+			for (size_t j = 0; j < BLOCK_SIZE; ++j)
+				if (blocks[i][j].alive)
+					function(reinterpret_cast<T *>(blocks[i][j].storage));
+	}
+
+private:
+	void grow()
+	{
+		blocks.push_back(std::make_unique<SLOT[]>(BLOCK_SIZE));
+
+		SLOT *block = blocks.back().get();
+
+		// last slot first, so creation fills a block in order
+		for (size_t i = BLOCK_SIZE; i > 0; --i) {
+			block[i - 1].alive = false;
+			free_slots.push_back(&block[i - 1]);
+		}
+	}
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+/*
+ * per frame timings of the main loop phases
+ *
+ * phases can run several times a frame (sim steps),
+ * their times add up. F3 shows an overlay, --profile
+ * writes one csv row per frame
+ */
+
+#include "render.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+enum PHASE {
+	PHASE_EVENTS = 0,
+	PHASE_COLLISION,
+	PHASE_PATH,
+	PHASE_OBJECTS,
+	PHASE_QUIZ,
+	PHASE_MAP,
+	PHASE_DRAW,
+	PHASE_UI,
+	PHASE_RENDER,
+	PHASE_CLEANUP,
+	PHASE_SIZE
+};
+
+enum COUNTER {
+	COUNTER_ITEMS = 0,
+	COUNTER_DRAWS,
+	COUNTER_TEXTURES,
+	COUNTER_TEXT,
+	COUNTER_CHUNKS,
+	COUNTER_TEXTURE_KB,
+	COUNTER_EVICTIONS,
+	COUNTER_RESTORES,
+	COUNTER_SIZE
+};
+
+class Profiler
+{
+private:
+	uint64_t frequency;
+	uint64_t frame_start;
+	uint64_t frame_count;
+
+	// counter values, this frame
+	uint64_t started[PHASE_SIZE];
+	uint64_t elapsed[PHASE_SIZE];
+	long counters[COUNTER_SIZE];
+
+	// sums since the overlay text was last rebuilt
+	uint64_t overlay_elapsed[PHASE_SIZE];
+	uint64_t overlay_total;
+	long overlay_counters[COUNTER_SIZE];
+	int overlay_frames;
+	uint64_t overlay_update;
+
+	bool overlay;
+	std::vector<std::string> lines;
+
+	std::ofstream csv;
+
+public:
+	Profiler();
+
+	// starts writing a row per frame to path
+	void openCsv(const std::filesystem::path &path);
+
+	void begin(PHASE phase);
+	void end(PHASE phase);
+	void setCounter(COUNTER counter, long value);
+
+	void toggleOverlay();
+	bool isOverlay();
+
+	// closes the frame, call once after present
+	void endFrame();
+	// queues the overlay text, call before present
+	void render(Renderer *renderer);
+
+	static const char *getName(PHASE phase);
+	static const char *getName(COUNTER counter);
+
+private:
+	double micros(uint64_t counts);
+};
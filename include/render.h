@@ -1,10 +1,17 @@
 #pragma once
 
+#include "assetcache.h"
+#include "vfs.h"
+
+#include <cstdint>
+#include <deque>
 #include <list>
-#include <queue>
+#include <memory>
 #include <string>
 #include <functional>
+#include <vector>
 #include <filesystem>
+#include <unordered_map>
 
 #ifdef __unix__
 #include <SDL2/SDL.h>
@@ -18,28 +25,151 @@
 
 #define MAX_TILE_LAYER 5
 
+// side length of an atlas page, clamped to what the renderer supports
+#define ATLAS_SIZE 2048
+// images bigger than this on either side get their own texture
+#define ATLAS_MAX_ITEM 64
+// over the VRAM budget, textures drawn this many frames back are kept
+#define EVICT_MIN_FRAMES 30
+
 enum COLOR {BLACK, GRAY, WHITE, RED, GREEN, BLUE};
 
 class Renderer;
+class TextureAtlas;
+class TextureManager;
+
+// interned texture path, hashed once when interned
+typedef uint32_t PathId;
+
+struct TextureHandle {
+	/*
+	 * cheap reference to a texture slot,
+	 * goes stale once the slot is reused
+	 */
+
+	uint32_t index = 0;
+	// slots start at generation 1, so default handles are never valid
+	uint32_t generation = 0;
+
+	bool operator==(const TextureHandle &other) const = default;
+};
+
+class AtlasPage
+{
+	/*
+	 * one big texture holding many small images
+	 * packed in shelves, left to right and top to bottom,
+	 * released regions are filled again by images of the same size
+	 */
+
+private:
+	SDL_Texture *texture;
+	int size;
+	int shelf_x;
+	int shelf_y;
+	int shelf_height;
+	long regions;
+	// released regions, taken again by images of the same size
+	std::vector<SDL_Rect> free_regions;
+
+public:
+	AtlasPage(Renderer *renderer, int size);
+	~AtlasPage();
+
+	// surface must be in the renderer format
+	bool insert(SDL_Surface *surface, SDL_Rect *region);
+	// only into a released region of the same size
+	bool reuse(SDL_Surface *surface, SDL_Rect *region);
+	void release(const SDL_Rect &region);
+
+	SDL_Texture *getTexture();
+	long getRegions();
+};
+
+class TextureAtlas
+{
+private:
+	Renderer *parent;
+	int page_size;
+	std::list<AtlasPage> pages;
+
+public:
+	TextureAtlas(Renderer *parent);
+
+	// returns nullptr if surface did not fit, caller keeps ownership
+	AtlasPage *insert(SDL_Surface *surface, SDL_Rect *region);
+	void release(AtlasPage *page, const SDL_Rect &region);
+
+	size_t getPageCount();
+	// of all pages, whatever is placed on them
+	size_t getBytes();
+};
 
 class Texture
 {
 private:
 	SDL_Texture *texture;
+	// set when texture is a region of an atlas page
+	AtlasPage *page;
+	TextureAtlas *atlas;
+	SDL_Rect region;
 	std::filesystem::path path;
+	// set for text textures
+	std::string text;
+	COLOR color;
 	int width;
 	int height;
 	long usage;
 	bool keep;
+	// pixels exist nowhere else, never evicted
+	bool target;
+
+	// set by TextureManager once placed in a slot
+	TextureManager *manager;
+	TextureHandle handle;
+	long released;
+	// cleanup frame of the last draw, least recent is evicted first
+	long last_used;
+
+	friend class TextureManager;
 
 public:
 
-	Texture(Renderer *renderer, std::filesystem::path path, bool keep = false);
+	Texture(Renderer *renderer, std::filesystem::path path, bool keep = false, TextureAtlas *atlas = nullptr);
+	// takes ownership of surface
+	Texture(Renderer *renderer, std::filesystem::path path, SDL_Surface *surface, bool keep = false, TextureAtlas *atlas = nullptr);
+	// blank render target
+	Texture(Renderer *renderer, int width, int height, bool keep = false);
 	Texture(Renderer *renderer, std::string text, COLOR color = BLACK, bool keep = false);
 	~Texture();
 
+	// safe to call from any thread, falls back to missing texture, always in format
+	// reads and fills cache when given
+	static SDL_Surface *loadSurface(const std::filesystem::path &path, AssetCache *cache = nullptr, Uint32 format = SDL_PIXELFORMAT_ARGB8888);
+	// safe to call from any thread, takes ownership
+	static SDL_Surface *convertSurface(SDL_Surface *surface, Uint32 format);
+	// FNV-1a over size and pixels, and an unrelated check hash from the same pass,
+	// surface must be 32 bit
+	static uint64_t hashSurface(SDL_Surface *surface, uint64_t *check);
+
+	// new pixels from the same file, takes ownership, handles stay valid
+	void reload(Renderer *renderer, SDL_Surface *surface);
+	// renders into the streaming texture, false if it is too small
+	bool setText(Renderer *renderer, const std::string &text, COLOR color);
+
+	// frees the pixels or atlas region but keeps the size, not for targets
+	void evict();
+	// decodes or renders again after evict
+	void restore(Renderer *renderer, AssetCache *cache);
+	bool isEvicted();
+	// texture memory held, 0 for atlas regions, the pages count instead
+	size_t getBytes();
+
 	SDL_Texture *getTexture();
+	SDL_Rect getRegion();
 	std::filesystem::path getPath();
+	const std::string &getText();
+	COLOR getColor();
 
 	int getWidth();
 	int getHeight();
@@ -49,6 +179,8 @@ public:
 	long getUsage();
 
 	bool isKeep();
+	bool isTarget();
+	TextureHandle getHandle() const;
 
 	bool operator==(const Texture &other) const;
 };
@@ -63,39 +195,154 @@ public:
 	TextureAccess(const TextureAccess &other);
 	~TextureAccess();
 
-	Texture *operator()();
+	Texture *operator()() const;
 	TextureAccess &operator=(const TextureAccess &other);
 	bool operator==(const TextureAccess &other) const;
+
+	// non owning, for the per frame hot paths
+	operator TextureHandle() const;
+	TextureHandle getHandle() const;
 };
 
 class TextureManager
 {
 private:
+	struct PathHash {
+		size_t operator()(const std::filesystem::path &path) const;
+	};
+
+	struct SLOT {
+		std::unique_ptr<Texture> texture;
+		uint32_t generation;
+		// 0 for text and targets, the missing texture's path
+		PathId path;
+		// other paths with the same pixels, sharing this texture
+		std::vector<PathId> aliases;
+		// 0 when not hashed
+		uint64_t hash;
+		// must match as well before another image shares this one
+		uint64_t check;
+		// of the file, only kept when watching
+		FileStamp stamp;
+	};
+
 	Renderer *parent;
-	std::list<Texture> textures;
+	// must outlive the textures placed in it
+	TextureAtlas atlas;
+	AssetCache cache;
+	// textures never move, handles check the generation
+	std::vector<SLOT> slots;
+	std::vector<uint32_t> free_slots;
+	// every path ever loaded keeps its id
+	std::unordered_map<std::filesystem::path, PathId, PathHash> path_ids;
+	std::vector<std::filesystem::path> path_names;
+	// slot per path id, NO_SLOT while not loaded
+	std::vector<uint32_t> index;
+	// text lookup by colour and string
+	std::unordered_map<std::string, uint32_t> text_index;
+	// image lookup by pixel hash, identical tiles share a slot
+	std::unordered_map<uint64_t, uint32_t> pixel_index;
+	unsigned long dedup_count;
+	unsigned long dedup_bytes;
+
+	// textures whose last TextureAccess went away since the last cleanup
+	std::vector<TextureHandle> released;
+	// unused text kept for reuse, oldest first
+	std::deque<std::pair<TextureHandle, long>> cooling;
+	long frame;
+	unsigned long text_created;
+	// files are polled for edits, every path keeps its own texture
+	bool watch;
+
+	// bytes of textures and atlas pages to stay under, 0 for no limit
+	size_t budget;
+	// held by textures outside the atlas
+	size_t texture_bytes;
+	// part of texture_bytes in render targets, they do not count to the budget
+	size_t target_bytes;
+	// eviction found nothing to reach the budget, not searched again before
+	long next_search;
+	// evicted right now, and counts since start
+	size_t evicted;
+	unsigned long use_hits;
+	unsigned long use_misses;
+	unsigned long evict_count;
+
+	friend class Texture;
 
 public:
 	TextureManager(Renderer *parent);
 
 	TextureAccess getMissingTexture();
-	TextureAccess loadTexture(std::filesystem::path path);
+	// same id for the same path, keep it to skip hashing the path on loads
+	PathId internPath(const std::filesystem::path &path);
+	TextureAccess loadTexture(PathId path);
+	TextureAccess loadTexture(const std::filesystem::path &path);
+	// decodes in parallel, result is in the same order as paths
+	std::vector<TextureAccess> loadTextures(const std::vector<PathId> &paths);
+	// surface decoded elsewhere, takes ownership, must be the main thread
+	TextureAccess uploadTexture(PathId path, SDL_Surface *surface);
 	TextureAccess makeText(std::string text, COLOR color = BLACK);
+	TextureAccess makeTarget(int width, int height);
+	// frees released textures, cost depends on how many were released
 	void cleanup();
+
+	// before anything loads, turns off sharing between identical images
+	void setWatch(bool watch);
+	// reloads images whose file changed, returns their paths
+	std::vector<std::filesystem::path> reloadChanged();
+
+	// least recently drawn images, tiles and text go past this, 0 turns it off,
+	// render targets are left out
+	void setBudget(size_t bytes);
+	// resident textures and their bytes with the atlas pages,
+	// draws served resident and restored, evictions since start
+	void getMemoryStats(size_t *count, size_t *bytes, unsigned long *hits, unsigned long *misses, unsigned long *evictions);
+
+	// nullptr if the handle went stale
+	Texture *getTexture(TextureHandle handle);
+	// for drawing, brings evicted textures back and marks them used
+	Texture *useTexture(TextureHandle handle);
+	size_t getTextureCount();
+	// text textures created since start, rewritten ones do not count
+	unsigned long getTextCreated();
+	// loads served by a texture with the same pixels, and the bytes not uploaded
+	void getDedupStats(unsigned long *count, unsigned long *bytes);
+
+	AssetCache *getCache();
+	TextureAtlas *getAtlas();
+
+private:
+	TextureAccess insert(std::unique_ptr<Texture> texture);
+	// evicts until bytes more fit in the budget
+	void reserve(size_t bytes);
+	void release(Texture *texture);
+	// empties the slot, the texture lives on with the caller
+	std::unique_ptr<Texture> take(uint32_t slot);
+	void destroy(uint32_t slot);
+
+	static std::string textKey(const std::string &text, COLOR color);
 };
 
 class RenderItem
 {
 private:
-	TextureAccess texture;
+	TextureHandle texture;
+	SDL_Rect source;
 	int pos_x;
 	int pos_y;
 	bool flip_vert;
 	bool flip_horz;
 	int layer;
 	bool overlay;
+	// drawn this many times the source size
+	int scale;
 
 public:
-	RenderItem(TextureAccess texture, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay = false);
+	RenderItem(const TextureAccess &texture, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay = false);
+	// part of the texture, like one frame of a sprite sheet,
+	// source is in texture pixels, never reads the texture itself
+	RenderItem(TextureHandle texture, SDL_Rect source, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay = false);
 
 	/* are these setters really necessary?
 	void setTexture(TextureAccess texture);
@@ -104,13 +351,18 @@ public:
 	void setLayer(int layer);
 	*/
 
-	TextureAccess getTexture() const;
+	// for textures holding a downsampled area
+	void setScale(int scale);
+
+	TextureHandle getTexture() const;
+	SDL_Rect getSource() const;
 	int getX() const;
 	int getY() const;
 	bool getFlipVert() const;
 	bool getFlipHorz() const;
 	int getLayer() const;
 	bool getOverlay() const;
+	int getScale() const;
 
 	auto operator<=>(const RenderItem &other) const;
 	// defined by compiler since C++20
@@ -123,25 +375,83 @@ class Renderer
 private:
 	SDL_Window *window;
 	SDL_Renderer *renderer;
+	// what the renderer takes without converting, every upload is in it
+	SDL_PixelFormat *format;
 	TextureManager *texture_manager;
 	TTF_Font *font;
+	FileSystem::View font_file;
 	int center_x, center_y;
-	std::priority_queue<RenderItem, std::vector<RenderItem>, std::greater<RenderItem>>
-	                render_queue;
+	// logical size, the world is drawn scale times bigger
+	int width, height;
+	double scale;
+
+	/*
+	 * one frame is filled while the other waits to be drawn,
+	 * so the next frame can be built while one is presented
+	 */
+	struct FRAME {
+		// one bucket of items per layer, reused every frame
+		std::vector<std::vector<RenderItem>> buckets;
+		int center_x, center_y;
+		double scale;
+		int items;
+	};
+
+	FRAME frames[2];
+	int building;
+	bool submitted;
+
+	// reused between frames for batched drawing
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	std::vector<SDL_Vertex> vertices;
+	std::vector<int> indices;
+#endif
+	SDL_Texture *batch_texture;
+	int batch_width, batch_height;
+
+	// since the last present, and of the last presented frame
+	int draw_count;
+	int last_items, last_draws;
 
 public:
-	Renderer();
+	// software is for headless runs without a gpu
+	Renderer(bool vsync = true, bool software = false);
 	~Renderer();
 
 	SDL_Renderer *getRenderer();
 	TextureManager *getTextureManager();
 	TTF_Font *getFont();
+	const SDL_PixelFormat *getFormat();
 
 	void setSize(int width, int height);
+	void getSize(int *width, int *height);
 	void setCenter(int x, int y);
+	// zoom, below 1 shows more of the world
+	void setScale(double scale);
+	double getScale();
+	// world area currently on screen
+	void getView(int *x, int *y, int *w, int *h);
+	// items submitted and draw calls of the last presented frame
+	void getStats(int *items, int *draws);
 
 	void addRenderItem(const RenderItem &item);
-	void addRenderItem(TextureAccess texture, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay = false);
+	void addRenderItem(const TextureAccess &texture, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay = false);
 
+	// draw items right away into target, positions are relative to it
+	void renderTo(TextureAccess &target, const std::vector<RenderItem> &items, double scale = 1);
+
+	// closes the frame being filled, present draws it
+	void submit();
+	// draws the submitted frame, blank if there is none
+	void present();
+	// submit and present
 	void operator()();
+
+private:
+	std::vector<RenderItem> &bucket(int layer);
+	// source of item inside the texture or its atlas page
+	static SDL_Rect getSource(Texture *texture, const RenderItem &item);
+	static SDL_RendererFlip getFlip(const RenderItem &item);
+	void batchItem(SDL_Texture *texture, SDL_Rect source, SDL_Rect pos, SDL_RendererFlip flip);
+	void flushBatch();
 };
@@ -47,15 +47,29 @@ private:
 	TextureAccess minimap;
 	TextureAccess point;
 
+	/*
+	 * open panels are composed into a texture once,
+	 * rebuilt only when what they show changes
+	 */
+	TextureAccess menu_panel;
+	std::string menu_key;
+	TextureAccess quiz_panel;
+	std::string quiz_key;
+	// bumped by displayQuiz
+	unsigned int quiz_version;
+
 public:
 	UIManager(Manager *parent);
 
 	void displayQuiz(std::string question, std::vector<std::string> answers);
 	void endQuiz();
+	// start in game, for scripted runs
+	void skipSplash();
 
 	void operator()(uint64_t delta);
 
 private:
-	int printText(std::string text, int x, int y, int max_char, int layer, COLOR color = BLACK);
+	int printText(std::vector<RenderItem> &items, std::string text, int x, int y, int max_char, COLOR color = BLACK);
+	void composePanel(TextureAccess &panel, const std::vector<RenderItem> &items);
 	void openDocumentation();
 };
@@ -0,0 +1,85 @@
+#pragma once
+
+/*
+ * data/ as one packed archive, ooq-pack builds it
+ *
+ * paths keep their data/ prefix everywhere, a loose file
+ * under data/ wins over the archive entry so edits show
+ * up without repacking, everything else is loose only
+ *
+ * layout, all little endian:
+ *   ArchiveHeader
+ *   index, per file: uint64 offset, uint64 size, int64 mtime,
+ *     uint16 length, path relative to data/
+ *   file contents, each aligned to 8 bytes
+ */
+
+#include "mappedfile.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <filesystem>
+
+#define ARCHIVE_PATH "data.ooqp"
+#define ARCHIVE_ROOT "data"
+#define ARCHIVE_VERSION 1
+
+// what a file looked like, edits show up as a different stamp
+struct FileStamp {
+	int64_t mtime = 0;
+	uint64_t size = 0;
+	bool exists = false;
+
+	bool operator==(const FileStamp &other) const = default;
+};
+
+struct ArchiveHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t count;
+	uint32_t index_size;
+	uint64_t size;
+};
+
+class FileSystem
+{
+public:
+	class View
+	{
+		/*
+		 * contents of one file, inside the archive mapping
+		 * or a mapping of its own for loose files
+		 */
+
+	private:
+		std::unique_ptr<MappedFile> file;
+		const char *data;
+		size_t size;
+
+	public:
+		View();
+		View(const char *data, size_t size);
+		View(const std::filesystem::path &path);
+
+		// nullptr for empty files
+		const char *getData() const;
+		size_t getSize() const;
+	};
+
+	// before anything loads, a missing archive leaves loose files only
+	static void mount(const std::filesystem::path &archive = ARCHIVE_PATH);
+	static void unmount();
+	static bool isMounted();
+
+	// all thread safe once mounted
+	static bool exists(const std::filesystem::path &path);
+	static bool stat(const std::filesystem::path &path, int64_t *mtime, uint64_t *size);
+	static FileStamp stamp(const std::filesystem::path &path);
+	static View open(const std::filesystem::path &path);
+	// whole file as text, for the istream based loaders
+	static std::string read(const std::filesystem::path &path);
+
+	// packs every file below root
+	static void pack(const std::filesystem::path &root, const std::filesystem::path &output);
+};
@@ -0,0 +1,105 @@
+#include "animation.h"
+
+#include "vfs.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+AnimationSet::AnimationSet(TextureManager *texture_manager, const std::filesystem::path &path)
+{
+	// throws if missing
+	std::istringstream data(FileSystem::read(path));
+	std::string line;
+
+	while (std::getline(data, line)) {
+		std::istringstream fields(line);
+		std::string key;
+
+		// blank lines and comments
+		if (not (fields >> key) or key[0] == '#')
+			continue;
+
+		if (key == "sheet") {
+			std::filesystem::path sheet_path;
+
+			if (not (fields >> sheet_path))
+				throw std::runtime_error("bad sheet in " + path.string());
+
+			sheet = texture_manager->loadTexture(sheet_path);
+		} else if (key == "clip") {
+			std::string name;
+			AnimationClip clip;
+
+			if (not (fields >> name >> clip.loop_frame >> clip.end_frame >> clip.stop_frame))
+				throw std::runtime_error("bad clip in " + path.string());
+
+			names.push_back(name);
+			clips.push_back(clip);
+		} else if (key == "frame") {
+			AnimationFrame frame;
+			SDL_Rect &rect = frame.source;
+
+			if (clips.empty() or
+			    not (fields >> rect.x >> rect.y >> rect.w >> rect.h >> frame.time) or
+			    rect.x < 0 or rect.y < 0 or rect.w <= 0 or rect.h <= 0)
+				throw std::runtime_error("bad frame in " + path.string());
+
+			clips.back().frames.push_back(frame);
+		} else {
+			throw std::runtime_error("unknown line in " + path.string() + ": " + line);
+		}
+	}
+
+	if (not sheet())
+		throw std::runtime_error("no sheet in " + path.string());
+
+	// frame numbers are used unchecked while playing
+	for (size_t i = 0; i < clips.size(); ++i) {
+		AnimationClip &clip = clips[i];
+		int count = clip.frames.size();
+
+		if (clip.loop_frame < 0 or clip.loop_frame > clip.end_frame or
+		    clip.end_frame >= count or
+		    clip.stop_frame < 0 or clip.stop_frame >= count)
+			throw std::runtime_error("bad frames in clip " + names[i] + " of " + path.string());
+
+		// outside the sheet would sample whatever lies next to it
+		for (auto &frame : clip.frames)
+			if (frame.source.x + frame.source.w > sheet()->getWidth() or
+			    frame.source.y + frame.source.h > sheet()->getHeight())
+				throw std::runtime_error("frame outside the sheet in clip " + names[i] + " of " + path.string());
+	}
+}
+
+AnimationSet::AnimationSet(const TextureAccess &texture) :
+	sheet(texture)
+{
+	int width = texture() ? texture()->getWidth() : 0;
+	int height = texture() ? texture()->getHeight() : 0;
+
+	clips.push_back({{{{0, 0, width, height}, 0}}, 0, 0, 0});
+	names.push_back("");
+}
+
+const TextureAccess &AnimationSet::getSheet() const
+{
+	return sheet;
+}
+
+int AnimationSet::findClip(const std::string &name) const
+{
+	for (size_t i = 0; i < names.size(); ++i)
+		if (names[i] == name)
+			return i;
+
+	return -1;
+}
+
+const AnimationClip &AnimationSet::getClip(int clip) const
+{
+	return clips[clip];
+}
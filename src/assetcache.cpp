@@ -0,0 +1,284 @@
+#include "assetcache.h"
+
+#include "lz.h"
+#include "vfs.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+static const char MAGIC[4] = {'O', 'O', 'Q', 'C'};
+
+template <typename T>
+static void append(std::vector<char> &buffer, const T &value)
+{
+	const char *bytes = reinterpret_cast<const char *>(&value);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+template <typename T>
+static T read(const char *data, size_t size, size_t *offset)
+{
+	T value;
+
+	if (*offset + sizeof(value) > size)
+		throw std::runtime_error("asset cache truncated");
+
+	std::memcpy(&value, data + *offset, sizeof(value));
+	*offset += sizeof(value);
+
+	return value;
+}
+
+AssetCache::AssetCache(const std::filesystem::path &path) :
+	path(path),
+	dirty(false),
+	hits(0),
+	misses(0)
+{
+	std::error_code error;
+
+	if (not std::filesystem::exists(path, error))
+		return;
+
+	// a broken cache is only slower, start over
+	try {
+		file = std::make_unique<MappedFile>(path);
+		parse();
+	} catch (std::exception &e) {
+		SDL_Log("asset cache: %s, rebuilding", e.what());
+		entries.clear();
+		file.reset();
+		dirty = true;
+	}
+}
+
+AssetCache::~AssetCache()
+{
+	try {
+		save();
+	} catch (std::exception &e) {
+		SDL_Log("asset cache: %s", e.what());
+	}
+}
+
+SDL_Surface *AssetCache::load(const std::filesystem::path &source)
+{
+	int64_t mtime;
+	uint64_t size;
+
+	if (not stat(source, &mtime, &size))
+		return nullptr;
+
+	ENTRY entry;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = entries.find(source.generic_string());
+
+		if (found == entries.end()) {
+			++misses;
+			return nullptr;
+		}
+
+		// art changed since, decode again
+		if (found->second.mtime != mtime or found->second.size != size) {
+			entries.erase(found);
+			dirty = true;
+			++misses;
+			return nullptr;
+		}
+
+		// the copy keeps a buffer alive if another thread replaces it
+		entry = found->second;
+		++hits;
+	}
+
+	SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, entry.width, entry.height, 32, entry.format);
+
+	if (not surface)
+		throw std::runtime_error(SDL_GetError());
+
+	size_t row = static_cast<size_t>(entry.width) * 4;
+	size_t raw_size = row * entry.height;
+
+	bool decoded;
+
+	if (surface->pitch >= 0 and static_cast<size_t>(surface->pitch) == row) {
+		decoded = lzDecompress(entry.data, entry.data_size, static_cast<char *>(surface->pixels), raw_size);
+	} else {
+		std::vector<char> raw(raw_size);
+		decoded = lzDecompress(entry.data, entry.data_size, raw.data(), raw_size);
+
+		for (uint32_t y = 0; decoded and y < entry.height; ++y)
+			std::memcpy(static_cast<char *>(surface->pixels) + y * surface->pitch, raw.data() + y * row, row);
+	}
+
+	if (not decoded) {
+		SDL_FreeSurface(surface);
+		SDL_Log("asset cache: corrupt entry for %s", source.string().c_str());
+
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.erase(source.generic_string());
+		dirty = true;
+
+		return nullptr;
+	}
+
+	return surface;
+}
+
+void AssetCache::store(const std::filesystem::path &source, SDL_Surface *surface)
+{
+	if (surface->format->BytesPerPixel != 4 or SDL_MUSTLOCK(surface))
+		return;
+
+	ENTRY entry;
+
+	if (not stat(source, &entry.mtime, &entry.size))
+		return;
+
+	entry.width = surface->w;
+	entry.height = surface->h;
+	entry.format = surface->format->format;
+
+	// rows only, pitch padding is garbage
+	size_t row = static_cast<size_t>(surface->w) * 4;
+	std::vector<char> raw(row * surface->h);
+
+	for (int y = 0; y < surface->h; ++y)
+		std::memcpy(raw.data() + y * row, static_cast<const char *>(surface->pixels) + y * surface->pitch, row);
+
+	entry.buffer = std::make_shared<std::vector<char>>(lzCompress(raw.data(), raw.size()));
+	entry.data = entry.buffer->data();
+	entry.data_size = entry.buffer->size();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	entries[source.generic_string()] = std::move(entry);
+	dirty = true;
+}
+
+void AssetCache::save()
+{
+	if (not dirty)
+		return;
+
+	std::vector<char> buffer(MAGIC, MAGIC + sizeof(MAGIC));
+	append(buffer, uint32_t(ASSET_CACHE_VERSION));
+
+	size_t count_offset = buffer.size();
+	append(buffer, uint32_t(0));
+
+	uint32_t count = 0;
+
+	for (auto &[source, entry] : entries) {
+		int64_t mtime;
+		uint64_t size;
+
+		// drop art that was removed or changed without being loaded again
+		if (not stat(source, &mtime, &size) or mtime != entry.mtime or size != entry.size)
+			continue;
+
+		if (source.size() > UINT16_MAX or entry.data_size > UINT32_MAX)
+			continue;
+
+		append(buffer, uint16_t(source.size()));
+		buffer.insert(buffer.end(), source.begin(), source.end());
+		append(buffer, entry.mtime);
+		append(buffer, entry.size);
+		append(buffer, entry.width);
+		append(buffer, entry.height);
+		append(buffer, entry.format);
+		append(buffer, uint32_t(entry.data_size));
+		buffer.insert(buffer.end(), entry.data, entry.data + entry.data_size);
+
+		++count;
+	}
+
+	std::memcpy(buffer.data() + count_offset, &count, sizeof(count));
+
+	// written aside first, a crash never leaves half a cache
+	std::filesystem::path temporary = path;
+	temporary += ".tmp";
+
+	if (path.has_parent_path())
+		std::filesystem::create_directories(path.parent_path());
+
+	{
+		std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+
+		if (not output.write(buffer.data(), buffer.size()))
+			throw std::runtime_error("cannot write " + temporary.string());
+	}
+
+	// nothing may point into the old file once it is replaced
+	entries.clear();
+	file.reset();
+
+	std::filesystem::rename(temporary, path);
+
+	file = std::make_unique<MappedFile>(path);
+	parse();
+
+	dirty = false;
+}
+
+void AssetCache::getStats(unsigned long *hits, unsigned long *misses)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	*hits = this->hits;
+	*misses = this->misses;
+}
+
+void AssetCache::parse()
+{
+	const char *data = file->getData();
+	size_t size = file->getSize();
+	size_t offset = 0;
+
+	if (not data or size < sizeof(MAGIC) or std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+		throw std::runtime_error("not an asset cache");
+
+	offset += sizeof(MAGIC);
+
+	if (read<uint32_t>(data, size, &offset) != ASSET_CACHE_VERSION)
+		throw std::runtime_error("old asset cache version");
+
+	uint32_t count = read<uint32_t>(data, size, &offset);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint16_t length = read<uint16_t>(data, size, &offset);
+
+		if (offset + length > size)
+			throw std::runtime_error("asset cache truncated");
+
+		std::string source(data + offset, length);
+		offset += length;
+
+		ENTRY entry;
+		entry.mtime = read<int64_t>(data, size, &offset);
+		entry.size = read<uint64_t>(data, size, &offset);
+		entry.width = read<uint32_t>(data, size, &offset);
+		entry.height = read<uint32_t>(data, size, &offset);
+		entry.format = read<uint32_t>(data, size, &offset);
+		entry.data_size = read<uint32_t>(data, size, &offset);
+
+		if (offset + entry.data_size > size)
+			throw std::runtime_error("asset cache truncated");
+
+		entry.data = data + offset;
+		offset += entry.data_size;
+
+		entries.emplace(std::move(source), std::move(entry));
+	}
+}
+
+bool AssetCache::stat(const std::filesystem::path &source, int64_t *mtime, uint64_t *size)
+{
+	// loose or packed, whichever loadSurface would read
+	return FileSystem::stat(source, mtime, size);
+}
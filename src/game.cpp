@@ -1,79 +1,509 @@
 #include "game.h"
 
 #include "config.h"
+#include "mapfile.h"
+#include "vfs.h"
 
 #include <algorithm>
 #include <limits>
 #include <cmath>
 #include <utility>
 #include <random>
-#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
 
 #if _WIN32
 #include <ciso646>
 #endif
 
+static void setSmooth(TextureAccess &texture)
+{
+	// scaled down chunks blend their pixels instead of dropping them
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+	SDL_SetTextureScaleMode(texture()->getTexture(), SDL_ScaleModeLinear);
+#endif
+}
+
 MapManager::MapManager(GameManager *parent) :
 	parent(parent),
 	renderer(parent->getRenderer()),
-	texture_manager(renderer->getTextureManager())
+	texture_manager(renderer->getTextureManager()),
+	input_handler(parent->getManager()->getInputHandler()),
+	current_map(-1),
+	chunks_x(0),
+	chunks_y(0),
+	resident_chunks(0),
+	render_resets(0),
+	last_ticket(0),
+	done_ticket(0),
+	pending_map(-1),
+	pending_ticket(0),
+	pending_respawn(false)
 {
 	// load available maps
-	std::ifstream maps_file("data/maps.txt");
+	maps = readMapList("data/maps.txt");
+}
+
+MapManager::~MapManager()
+{
+	while (not preloads.empty())
+		dropPreload(preloads.begin());
+}
+
+void MapManager::loadMap(int map, bool respawn)
+{
+	// a finished preload saves the parse and most of the decoding
+	for (auto it = preloads.begin(); it != preloads.end(); ++it)
+		if (it->map == map) {
+			it->worker.join();
+
+			if (it->error) {
+				std::exception_ptr error = it->error;
+				dropPreload(it);
+				std::rethrow_exception(error);
+			}
+
+			applyMap(map, *it->data, &it->surfaces, respawn);
+			dropPreload(it);
+			return;
+		}
+
+	std::unique_ptr<MapFile> data = openMap(maps.at(map));
+	applyMap(map, *data, nullptr, respawn);
+}
+
+int MapManager::requestMap(int map, bool respawn)
+{
+	if (map < 0 or static_cast<size_t>(map) >= maps.size() or maps[map].empty())
+		throw std::out_of_range("no such map");
 
-	int id;
-	std::filesystem::path path;
+	// a later request replaces one still waiting
+	pending_map = map;
+	pending_respawn = respawn;
+	pending_ticket = ++last_ticket;
+
+	preloadMap(map);
+
+	return pending_ticket;
+}
+
+void MapManager::preloadMap(int map)
+{
+	if (map < 0 or static_cast<size_t>(map) >= maps.size() or maps[map].empty())
+		throw std::out_of_range("no such map");
+
+	for (auto &it : preloads)
+		if (it.map == map)
+			return;
+
+	// forget the oldest finished preloads nobody asked for
+	for (auto it = preloads.begin(); it != preloads.end() and preloads.size() >= PRELOAD_MAX;)
+		if (it->ready and it->map != pending_map)
+			dropPreload(it++);
+		else
+			++it;
+
+	startPreload(map);
+}
+
+bool MapManager::isLoaded(int ticket)
+{
+	return ticket <= done_ticket;
+}
+
+int MapManager::getCurrentMap()
+{
+	return current_map;
+}
+
+void MapManager::update()
+{
+	if (pending_map < 0)
+		return;
 
-	while (maps_file >> id >> path) {
-		if (id >= maps.size())
-			maps.resize(id + 1);
+	auto it = std::find_if(preloads.begin(), preloads.end(), [&](const PRELOAD &preload) {
+		return preload.map == pending_map;
+	});
 
-		maps[id] = path;
+	// keep playing the current map until the worker is done
+	if (it == preloads.end() or not it->ready)
+		return;
+
+	it->worker.join();
+
+	int map = pending_map;
+	bool respawn = pending_respawn;
+
+	pending_map = -1;
+	done_ticket = pending_ticket;
+
+	if (it->error) {
+		std::exception_ptr error = it->error;
+		dropPreload(it);
+		std::rethrow_exception(error);
 	}
+
+	applyMap(map, *it->data, &it->surfaces, respawn);
+	dropPreload(it);
 }
 
-void MapManager::loadMap(int map, bool respawn)
+MapManager::PRELOAD &MapManager::startPreload(int map)
 {
-	// don't reload maps?
-	//if (map == current_map)
-	//	return;
+	PRELOAD &preload = preloads.emplace_back();
 
-	std::ifstream data(maps[map]);
+	preload.map = map;
+	preload.ready = false;
+	preload.worker = std::thread(runPreload, &preload, maps[map], texture_manager->getCache(), renderer->getFormat()->format);
 
+	return preload;
+}
+
+void MapManager::dropPreload(std::list<PRELOAD>::iterator preload)
+{
+	if (preload->worker.joinable())
+		preload->worker.join();
+
+	for (auto surface : preload->surfaces)
+		if (surface)
+			SDL_FreeSurface(surface);
+
+	preloads.erase(preload);
+}
+
+std::unique_ptr<MapFile> MapManager::openMap(const std::filesystem::path &source)
+{
+	// prefer the compiled map, the text source still works while editing
+	std::filesystem::path compiled = source;
+	compiled.replace_extension(MAP_EXTENSION);
+
+	FileStamp source_now = FileSystem::stamp(source);
+	FileStamp compiled_now = FileSystem::stamp(compiled);
+
+	// text edited since the last ooq-mapc run wins over the compiled map
+	if (compiled_now.exists and
+	    (not source_now.exists or compiled_now.mtime >= source_now.mtime))
+		return std::make_unique<MapFile>(compiled);
+
+	return std::make_unique<MapFile>(readMapText(source));
+}
+
+void MapManager::runPreload(PRELOAD *preload, std::filesystem::path source, AssetCache *cache, Uint32 format)
+{
+	try {
+		preload->data = openMap(source);
+		MapFile &data = *preload->data;
+
+		int size_x, size_y, spawn_x, spawn_y;
+		data.getSize(&size_x, &size_y);
+		data.getSpawn(&spawn_x, &spawn_y);
+
+		const auto &tiles = data.getTiles();
+		preload->surfaces.assign(tiles.size() + 1, nullptr);
+
+		// what the first frames after the switch draw
+		int chunk_x = std::clamp(spawn_x, 0, std::max(size_x - 1, 0)) / CHUNK_SIZE;
+		int chunk_y = std::clamp(spawn_y, 0, std::max(size_y - 1, 0)) / CHUNK_SIZE;
+
+		int begin_x = std::max(0, (chunk_x - PRELOAD_RADIUS) * CHUNK_SIZE);
+		int begin_y = std::max(0, (chunk_y - PRELOAD_RADIUS) * CHUNK_SIZE);
+		int end_x = std::min(size_x, (chunk_x + PRELOAD_RADIUS + 1) * CHUNK_SIZE);
+		int end_y = std::min(size_y, (chunk_y + PRELOAD_RADIUS + 1) * CHUNK_SIZE);
+
+		for (int layer = 0; layer < MAP_LAYERS; ++layer)
+			for (int j = begin_y; j < end_y; ++j) {
+				const uint16_t *row = data.getRow(layer, j);
+
+				for (int i = begin_x; i < end_x; ++i) {
+					uint16_t id = row[i];
+
+					if (id and id <= tiles.size() and not preload->surfaces[id])
+						preload->surfaces[id] = Texture::loadSurface(std::filesystem::path(tiles[id - 1]), cache, format);
+				}
+			}
+	} catch (...) {
+		preload->error = std::current_exception();
+	}
+
+	preload->ready = true;
+}
+
+void MapManager::applyMap(int map, MapFile &data, std::vector<SDL_Surface *> *surfaces, bool respawn)
+{
 	// update current map
 	current_map = map;
 
 	// clear old data
-	resizeMapStorage(-1, -1, true);
+	int size_x, size_y;
+	data.getSize(&size_x, &size_y);
+
+	for (auto &layer : tile)
+		layer.resize(size_x, size_y);
+
+	collision.resize(size_x, size_y);
 
 	// read default spawn coords
-	data >> spawn_x >> spawn_y;
+	data.getSpawn(&spawn_x, &spawn_y);
 
-	// set player to spawn if requested
+	// set players to spawn if requested
 	if (respawn)
-		parent->getPlayer()->setMapPos(spawn_x, spawn_y, false);
-
-	int pos_x, pos_y;
-	std::filesystem::path path;
-
-	while (data >> pos_x >> pos_y >> path) {
-		// expand map storage if needed
-		resizeMapStorage(pos_x, pos_y);
-
-		if (path.extension() == ".png") {
-			// load tile
-			bool coll;
-			int layer;
-			data >> coll >> layer;
-
-			tile[pos_x][pos_y][layer] = texture_manager->loadTexture(path);
-			collision[pos_x][pos_y] = coll;
-		} else if (path.extension() == ".txt") {
-			// load object
-			//int map_x, map_y;
-			//data >> map_x >> map_y;
-			parent->loadObject(path, pos_x, pos_y);
+		for (int type = 0; type < INPUT_PLAYERS; ++type)
+			if (parent->getPlayer(type))
+				parent->getPlayer(type)->spawn();
+
+	// drop the old chunks before their tiles
+	chunks.clear();
+	resident_chunks = 0;
+
+	// tile ids index straight into the table, id 0 stays empty
+	tile_table.assign(1, TILE());
+
+	// textures load once a chunk using them comes near a camera
+	for (auto &it : data.getTiles()) {
+		std::filesystem::path path(it);
+		tile_table.push_back({path, texture_manager->internPath(path), TextureAccess(), 0});
+	}
+
+	// decoded in the background, only the upload is left
+	if (surfaces)
+		for (size_t id = 1; id < surfaces->size() and id < tile_table.size(); ++id)
+			if ((*surfaces)[id]) {
+				tile_table[id].texture = texture_manager->uploadTexture(tile_table[id].path_id, (*surfaces)[id]);
+				(*surfaces)[id] = nullptr;
+			}
+
+	for (int layer = 0; layer < MAP_LAYERS; ++layer)
+		for (int j = 0; j < size_y; ++j) {
+			const uint16_t *source = data.getRow(layer, j);
+			uint16_t *row = tile[layer].getRow(j);
+
+			for (int i = 0; i < size_x; ++i)
+				row[i] = source[i] < tile_table.size() ? source[i] : 0;
 		}
+
+	// both use the same padded row layout
+	for (int j = 0; j < size_y; ++j)
+		std::copy_n(data.getCollisionRow(j), collision.getStride(), collision.getRow(j));
+
+	// objects of the previous map do not carry over
+	parent->clearObjects();
+	parent->getPathFinder()->reset();
+
+	placed.clear();
+
+	for (auto &it : data.getObjects()) {
+		placed.push_back({it.pos_x, it.pos_y, std::filesystem::path(it.path)});
+		parent->loadObject(std::filesystem::path(it.path), it.pos_x, it.pos_y);
+	}
+
+	stampMap();
+
+	// chunks are built lazily once they come into view
+	resetChunks();
+}
+
+void MapManager::patchMap(MapFile &data)
+{
+	int size_x, size_y;
+	data.getSize(&size_x, &size_y);
+
+	int old_x, old_y;
+	getSize(&old_x, &old_y);
+
+	// grids and chunks are laid out by size, a resize starts over
+	if (size_x != old_x or size_y != old_y) {
+		// pickups not collected yet come back with the new map
+		for (auto &it : placed)
+			parent->unloadMapObject(it.path, it.pos_x, it.pos_y);
+
+		applyMap(current_map, data, nullptr, false);
+		return;
+	}
+
+	data.getSpawn(&spawn_x, &spawn_y);
+
+	// ids of the new file to ours, unknown paths are appended
+	std::unordered_map<std::filesystem::path::string_type, uint16_t> known;
+
+	for (size_t id = 1; id < tile_table.size(); ++id)
+		known.emplace(tile_table[id].path.native(), id);
+
+	std::vector<uint16_t> remap(1, 0);
+
+	for (auto &it : data.getTiles()) {
+		std::filesystem::path path(it);
+		auto found = known.find(path.native());
+
+		if (found == known.end()) {
+			if (tile_table.size() > UINT16_MAX)
+				throw std::runtime_error("too many tiles");
+
+			tile_table.push_back({path, texture_manager->internPath(path), TextureAccess(), 0});
+			found = known.emplace(path.native(), tile_table.size() - 1).first;
+		}
+
+		remap.push_back(found->second);
+	}
+
+	int cells = 0;
+
+	for (int layer = 0; layer < MAP_LAYERS; ++layer)
+		for (int j = 0; j < size_y; ++j) {
+			const uint16_t *row = data.getRow(layer, j);
+
+			for (int i = 0; i < size_x; ++i) {
+				uint16_t id = row[i] < remap.size() ? remap[row[i]] : 0;
+
+				if (tile[layer](i, j) != id) {
+					setTile(i, j, layer, id);
+					++cells;
+				}
+			}
+		}
+
+	// a word at a time, paths around changed cells are searched again
+	for (int j = 0; j < size_y; ++j) {
+		const uint64_t *source = data.getCollisionRow(j);
+		uint64_t *row = collision.getRow(j);
+
+		for (size_t word = 0; word < collision.getStride(); ++word) {
+			uint64_t diff = source[word] ^ row[word];
+
+			if (not diff)
+				continue;
+
+			row[word] = source[word];
+
+			for (int bit = 0; bit < 64; ++bit)
+				if ((diff >> bit) & 1) {
+					parent->getPathFinder()->invalidate(word * 64 + bit, j, 1, 1);
+					++cells;
+				}
+		}
+	}
+
+	std::vector<MapData::OBJECT> next;
+
+	for (auto &it : data.getObjects())
+		next.push_back({it.pos_x, it.pos_y, std::filesystem::path(it.path)});
+
+	// entries in both stay as they are, collected pickups stay collected
+	std::vector<bool> kept(next.size(), false);
+	int objects = 0;
+
+	for (auto &old : placed) {
+		size_t i = 0;
+
+		while (i < next.size() and (kept[i] or next[i].pos_x != old.pos_x or
+		       next[i].pos_y != old.pos_y or next[i].path != old.path))
+			++i;
+
+		if (i < next.size()) {
+			kept[i] = true;
+		} else {
+			parent->unloadMapObject(old.path, old.pos_x, old.pos_y);
+			++objects;
+		}
+	}
+
+	for (size_t i = 0; i < next.size(); ++i)
+		if (not kept[i]) {
+			parent->loadObject(next[i].path, next[i].pos_x, next[i].pos_y);
+			++objects;
+		}
+
+	placed = std::move(next);
+
+	for (auto &it : placed)
+		object_stamps.emplace(it.path, FileSystem::stamp(it.path));
+
+	SDL_Log("hot reload: %d cells and %d objects changed", cells, objects);
+}
+
+void MapManager::stampMap()
+{
+	std::filesystem::path compiled = maps[current_map];
+	compiled.replace_extension(MAP_EXTENSION);
+
+	source_stamp = FileSystem::stamp(maps[current_map]);
+	compiled_stamp = FileSystem::stamp(compiled);
+
+	object_stamps.clear();
+
+	for (auto &it : placed)
+		object_stamps.emplace(it.path, FileSystem::stamp(it.path));
+}
+
+void MapManager::hotReload(const std::vector<std::filesystem::path> &textures)
+{
+	// chunks drawn with a reloaded tile are drawn again
+	if (not textures.empty()) {
+		std::vector<bool> changed(tile_table.size(), false);
+
+		for (size_t id = 1; id < tile_table.size(); ++id)
+			changed[id] = std::find(textures.begin(), textures.end(), tile_table[id].path) != textures.end();
+
+		for (int chunk_y = 0; chunk_y < chunks_y; ++chunk_y)
+			for (int chunk_x = 0; chunk_x < chunks_x; ++chunk_x)
+				for (auto id : chunks[chunk_y * chunks_x + chunk_x].tiles)
+					if (changed[id]) {
+						markChunk(chunk_x, chunk_y);
+						break;
+					}
+	}
+
+	if (current_map < 0)
+		return;
+
+	std::filesystem::path source = maps[current_map];
+	std::filesystem::path compiled = source;
+	compiled.replace_extension(MAP_EXTENSION);
+
+	FileStamp source_now = FileSystem::stamp(source);
+	FileStamp compiled_now = FileSystem::stamp(compiled);
+
+	// taken first, a broken save is reported once and not every poll
+	bool source_changed = source_now != source_stamp;
+	bool compiled_changed = compiled_now != compiled_stamp;
+	source_stamp = source_now;
+	compiled_stamp = compiled_now;
+
+	try {
+		std::unique_ptr<MapFile> data;
+
+		// the text is what gets edited, a stale compiled map must not win
+		if (source_changed and source_now.exists)
+			data = std::make_unique<MapFile>(readMapText(source));
+		else if (compiled_changed and compiled_now.exists)
+			data = std::make_unique<MapFile>(compiled);
+
+		if (data) {
+			// decoded from the old files
+			for (auto it = preloads.begin(); it != preloads.end();)
+				if (it->ready and it->map == current_map and it->map != pending_map)
+					dropPreload(it++);
+				else
+					++it;
+
+			patchMap(*data);
+		}
+
+		// objects whose own file changed are loaded again where they stand
+		for (auto &[path, stamp] : object_stamps) {
+			FileStamp now = FileSystem::stamp(path);
+
+			if (now == stamp)
+				continue;
+
+			stamp = now;
+
+			for (auto &it : placed)
+				if (it.path == path and parent->unloadMapObject(it.path, it.pos_x, it.pos_y))
+					parent->loadObject(it.path, it.pos_x, it.pos_y);
+		}
+	} catch (const std::exception &error) {
+		// keeps what loaded last, the next save tries again
+		SDL_Log("hot reload: %s", error.what());
 	}
 }
 
@@ -83,99 +513,517 @@ void MapManager::getSpawn(int *x, int *y)
 	*y = spawn_y;
 }
 
- bool MapManager::getCollision(int pos_x, int pos_y)
-{
-	if (pos_x < 0 or pos_y < 0 or pos_x >= collision.size() or pos_y >=
-	    collision[pos_x].size())
-		return true; // default collision for OOB
+bool MapManager::getCollision(int pos_x, int pos_y)
+{
+	// default collision for OOB
+	return collision.any(pos_x, pos_y, 1, 1);
+}
+
+bool MapManager::getCollision(int pos_x, int pos_y, int size_x, int size_y)
+{
+	return collision.any(pos_x, pos_y, size_x, size_y);
+}
+
+void MapManager::getSize(int *x, int *y)
+{
+	*x = tile[0].getWidth();
+	*y = tile[0].getHeight();
+}
+
+uint16_t MapManager::addTile(TextureAccess texture)
+{
+	if (not texture())
+		return 0;
+
+	PathId path = texture_manager->internPath(texture()->getPath());
+
+	for (size_t i = 1; i < tile_table.size(); ++i)
+		if (tile_table[i].path_id == path)
+			return i;
+
+	if (tile_table.size() > UINT16_MAX)
+		throw std::runtime_error("too many tiles");
+
+	// stays loaded until a chunk using it is released
+	tile_table.push_back({texture()->getPath(), path, texture, 0});
+	return tile_table.size() - 1;
+}
+
+void MapManager::setTile(int pos_x, int pos_y, int layer, uint16_t id)
+{
+	if (layer < 0 or layer >= MAP_LAYERS or
+	    not tile[layer].contains(pos_x, pos_y) or id >= tile_table.size())
+		return;
+
+	tile[layer](pos_x, pos_y) = id;
+
+	int chunk = (pos_y / CHUNK_SIZE) * chunks_x + pos_x / CHUNK_SIZE;
+	if (chunk < 0 or static_cast<size_t>(chunk) >= chunks.size())
+		return;
+
+	CHUNK &target = chunks[chunk];
+	markChunk(pos_x / CHUNK_SIZE, pos_y / CHUNK_SIZE);
+
+	// old ids stay listed and loaded until the chunk is released,
+	// loading it again lists only what its cells still hold
+	if (id == 0 or std::find(target.tiles.begin(), target.tiles.end(), id) != target.tiles.end())
+		return;
+
+	target.tiles.push_back(id);
+
+	if (target.resident)
+		acquireTile(id);
+}
+
+void MapManager::stream(const std::vector<CAMERA> &cameras)
+{
+	static const int CHUNK_PIXELS = CHUNK_SIZE * TILE_SIZE;
+
+	int view_x, view_y, view_w, view_h;
+	renderer->getView(&view_x, &view_y, &view_w, &view_h);
+
+	// lods cover a zoomed out view, chunks only stay for zooming back in
+	bool close = getLodLevel() == 0;
+	int center_x = view_x + view_w / 2;
+	int center_y = view_y + view_h / 2;
+
+	if (not close)
+		renderer->getSize(&view_w, &view_h);
+
+	// chunks within margin of the view around each camera
+	std::vector<bool> keep(chunks.size(), false);
+	std::vector<bool> near(chunks.size(), false);
+	std::vector<int> load;
+
+	auto mark = [&](std::vector<bool> &marked, int x, int y, int margin) {
+		int begin_x = std::max(0, (x - view_w / 2) / CHUNK_PIXELS - margin);
+		int begin_y = std::max(0, (y - view_h / 2) / CHUNK_PIXELS - margin);
+		int end_x = std::min(chunks_x, (x + view_w / 2) / CHUNK_PIXELS + margin + 1);
+		int end_y = std::min(chunks_y, (y + view_h / 2) / CHUNK_PIXELS + margin + 1);
+
+		for (int j = begin_y; j < end_y; ++j)
+			for (int i = begin_x; i < end_x; ++i)
+				marked[j * chunks_x + i] = true;
+	};
+
+	// what is on screen, the view sits between several cameras
+	if (close) {
+		mark(keep, center_x, center_y, STREAM_MARGIN);
+		mark(near, center_x, center_y, STREAM_MARGIN + 1);
+	}
+
+	for (auto &camera : cameras) {
+		mark(keep, camera.x, camera.y, STREAM_MARGIN);
+		mark(near, camera.x, camera.y, STREAM_MARGIN + 1);
+
+		// a chunk further along the way the camera is moving
+		int ahead_x = camera.x + sgn(camera.vel_x) * CHUNK_PIXELS;
+		int ahead_y = camera.y + sgn(camera.vel_y) * CHUNK_PIXELS;
+
+		if (ahead_x != camera.x or ahead_y != camera.y) {
+			mark(keep, ahead_x, ahead_y, STREAM_MARGIN);
+			mark(near, ahead_x, ahead_y, STREAM_MARGIN + 1);
+		}
+	}
+
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		if (chunks[i].resident and not near[i])
+			releaseChunk(i);
+		else if (not chunks[i].resident and keep[i] and load.size() < STREAM_BUDGET)
+			load.push_back(i);
+	}
+
+	loadChunks(load);
+}
+
+int MapManager::getResidentChunks()
+{
+	return resident_chunks;
+}
+
+void MapManager::render()
+{
+	// chunk textures are gone after a target or device reset
+	if (input_handler->getRenderResets() != render_resets) {
+		render_resets = input_handler->getRenderResets();
+
+		for (auto &chunk : chunks)
+			chunk.dirty = true;
+
+		for (auto &level : lods)
+			for (auto &lod : level)
+				lod.dirty = true;
+	}
+
+	/*
+	 * only submit chunks overlapping the view,
+	 * the margin covers the camera moving
+	 * after the map was submitted this frame
+	 */
+	static const int MARGIN = 2 * TILE_SIZE;
+	static const int CHUNK_PIXELS = CHUNK_SIZE * TILE_SIZE;
+
+	int view_x, view_y, view_w, view_h;
+	renderer->getView(&view_x, &view_y, &view_w, &view_h);
+
+	int level = getLodLevel();
+	int pixels = CHUNK_PIXELS << level;
+
+	int begin_x = std::max(0, (view_x - MARGIN) / pixels);
+	int begin_y = std::max(0, (view_y - MARGIN) / pixels);
+	int end_x = std::min(level ? lods_x[level] : chunks_x, (view_x + view_w + MARGIN) / pixels + 1);
+	int end_y = std::min(level ? lods_y[level] : chunks_y, (view_y + view_h + MARGIN) / pixels + 1);
+
+	// visible chunks the prefetch did not reach load now
+	std::vector<int> load;
+
+	if (level > 0) {
+		// only dirty lods need their chunks, they go again once built
+		for (int i = begin_x; i < end_x; ++i)
+			for (int j = begin_y; j < end_y; ++j) {
+				if (not lods[level][j * lods_x[level] + i].dirty)
+					continue;
+
+				int chunk_end_x = std::min(chunks_x, (i + 1) << level);
+				int chunk_end_y = std::min(chunks_y, (j + 1) << level);
+
+				for (int x = i << level; x < chunk_end_x; ++x)
+					for (int y = j << level; y < chunk_end_y; ++y)
+						if (not chunks[y * chunks_x + x].resident)
+							load.push_back(y * chunks_x + x);
+			}
+
+		loadChunks(load);
+
+		for (int i = begin_x; i < end_x; ++i)
+			for (int j = begin_y; j < end_y; ++j) {
+				LOD &lod = lods[level][j * lods_x[level] + i];
+
+				if (lod.dirty)
+					buildLod(level, i, j);
+
+				for (int layer = 0; layer < MAP_LAYERS; ++layer) {
+					if (not lod.layer[layer]())
+						continue;
+
+					// tile layer 1 goes above objects
+					RenderItem item(lod.layer[layer], i * pixels, j * pixels, false, false, layer * 2);
+					item.setScale(1 << level);
+					renderer->addRenderItem(item);
+				}
+			}
+
+		return;
+	}
+
+	for (int i = begin_x; i < end_x; ++i)
+		for (int j = begin_y; j < end_y; ++j)
+			if (not chunks[j * chunks_x + i].resident)
+				load.push_back(j * chunks_x + i);
+
+	loadChunks(load);
+
+	for (int i = begin_x; i < end_x; ++i)
+		for (int j = begin_y; j < end_y; ++j) {
+			CHUNK &chunk = chunks[j * chunks_x + i];
+
+			if (chunk.dirty)
+				buildChunk(i, j);
+
+			// tile layer 1 goes above objects
+			if (chunk.layer[0]())
+				renderer->addRenderItem(chunk.layer[0], i * CHUNK_PIXELS, j * CHUNK_PIXELS, false, false, 0);
+
+			if (chunk.layer[1]())
+				renderer->addRenderItem(chunk.layer[1], i * CHUNK_PIXELS, j * CHUNK_PIXELS, false, false, 2);
+		}
+}
+
+void MapManager::resetChunks()
+{
+	int size_x, size_y;
+	getSize(&size_x, &size_y);
+
+	chunks_x = (size_x + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunks_y = (size_y + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	// drops the old chunk textures
+	for (size_t i = 0; i < chunks.size(); ++i)
+		if (chunks[i].resident)
+			releaseChunk(i);
+
+	chunks.assign(chunks_x * chunks_y, CHUNK());
+
+	for (int level = 1; level < LOD_LEVELS; ++level) {
+		lods_x[level] = (chunks_x + (1 << level) - 1) >> level;
+		lods_y[level] = (chunks_y + (1 << level) - 1) >> level;
+
+		lods[level].assign(lods_x[level] * lods_y[level], LOD());
+
+		for (auto &lod : lods[level])
+			lod.dirty = true;
+	}
+
+	// list the tiles each chunk needs, once per map
+	std::vector<bool> seen(tile_table.size(), false);
+
+	for (size_t chunk = 0; chunk < chunks.size(); ++chunk) {
+		chunks[chunk].dirty = true;
+		chunks[chunk].resident = false;
+
+		listTiles(chunk, &seen);
+	}
+}
+
+void MapManager::listTiles(int chunk, std::vector<bool> *seen)
+{
+	CHUNK &target = chunks[chunk];
+	target.tiles.clear();
+
+	int size_x, size_y;
+	getSize(&size_x, &size_y);
+
+	int begin_x = (chunk % chunks_x) * CHUNK_SIZE;
+	int begin_y = (chunk / chunks_x) * CHUNK_SIZE;
+	int end_x = std::min(size_x, begin_x + CHUNK_SIZE);
+	int end_y = std::min(size_y, begin_y + CHUNK_SIZE);
+
+	for (int layer = 0; layer < MAP_LAYERS; ++layer)
+		for (int j = begin_y; j < end_y; ++j)
+			for (int i = begin_x; i < end_x; ++i) {
+				uint16_t id = tile[layer](i, j);
+
+				if (id and not (*seen)[id]) {
+					(*seen)[id] = true;
+					target.tiles.push_back(id);
+				}
+			}
+
+	for (auto id : target.tiles)
+		(*seen)[id] = false;
+}
+
+void MapManager::loadChunks(const std::vector<int> &load)
+{
+	if (load.empty())
+		return;
+
+	// tiles nobody holds yet, decoded together
+	std::vector<uint16_t> ids;
+	std::vector<PathId> paths;
+	std::vector<bool> queued(tile_table.size(), false);
+
+	// drops ids setTile replaced while the chunk was last resident
+	for (auto chunk : load)
+		listTiles(chunk, &queued);
+
+	for (auto chunk : load)
+		for (auto id : chunks[chunk].tiles)
+			if (not tile_table[id].texture() and not queued[id]) {
+				queued[id] = true;
+				ids.push_back(id);
+				paths.push_back(tile_table[id].path_id);
+			}
+
+	std::vector<TextureAccess> textures = texture_manager->loadTextures(paths);
+
+	for (size_t i = 0; i < ids.size(); ++i)
+		tile_table[ids[i]].texture = textures[i];
+
+	for (auto chunk : load) {
+		for (auto id : chunks[chunk].tiles)
+			++tile_table[id].users;
+
+		chunks[chunk].resident = true;
+		chunks[chunk].dirty = true;
+		++resident_chunks;
+	}
+}
+
+void MapManager::releaseChunk(int chunk)
+{
+	CHUNK &target = chunks[chunk];
+
+	for (auto id : target.tiles)
+		releaseTile(id);
+
+	// cached layers go too, they are rebuilt on the way back
+	for (auto &layer : target.layer)
+		layer = TextureAccess();
+
+	target.resident = false;
+	target.dirty = true;
+	--resident_chunks;
+}
+
+void MapManager::acquireTile(uint16_t id)
+{
+	if (tile_table[id].users++ == 0 and not tile_table[id].texture())
+		tile_table[id].texture = texture_manager->loadTexture(tile_table[id].path_id);
+}
+
+void MapManager::releaseTile(uint16_t id)
+{
+	// freed on the next cleanup unless another map took it
+	if (--tile_table[id].users == 0)
+		tile_table[id].texture = TextureAccess();
+}
+
+void MapManager::buildChunk(int chunk_x, int chunk_y)
+{
+	static const int CHUNK_PIXELS = CHUNK_SIZE * TILE_SIZE;
+
+	CHUNK &chunk = chunks[chunk_y * chunks_x + chunk_x];
+	chunk.dirty = false;
+
+	int size_x, size_y;
+	getSize(&size_x, &size_y);
+
+	int begin_x = chunk_x * CHUNK_SIZE;
+	int begin_y = chunk_y * CHUNK_SIZE;
+	int end_x = std::min(size_x, begin_x + CHUNK_SIZE);
+	int end_y = std::min(size_y, begin_y + CHUNK_SIZE);
+
+	TextureAccess missing = texture_manager->getMissingTexture();
+	std::vector<RenderItem> items;
+
+	for (int layer = 0; layer < MAP_LAYERS; ++layer) {
+		items.clear();
+
+		for (int i = begin_x; i < end_x; ++i)
+			for (int j = begin_y; j < end_y; ++j)
+				if (tile[layer](i, j) and tile_table[tile[layer](i, j)].texture != missing)
+					items.emplace_back(
+						tile_table[tile[layer](i, j)].texture,
+						(i - begin_x) * TILE_SIZE,
+						(j - begin_y) * TILE_SIZE,
+						false, false, 0, true
+					);
+
+		// no texture at all for empty layers
+		if (items.empty()) {
+			chunk.layer[layer] = TextureAccess();
+			continue;
+		}
+
+		if (not chunk.layer[layer]()) {
+			chunk.layer[layer] = texture_manager->makeTarget(CHUNK_PIXELS, CHUNK_PIXELS);
+			setSmooth(chunk.layer[layer]);
+		}
+
+		renderer->renderTo(chunk.layer[layer], items);
+	}
+}
+
+void MapManager::markChunk(int chunk_x, int chunk_y)
+{
+	chunks[chunk_y * chunks_x + chunk_x].dirty = true;
+
+	for (int level = 1; level < LOD_LEVELS; ++level)
+		lods[level][(chunk_y >> level) * lods_x[level] + (chunk_x >> level)].dirty = true;
+}
+
+void MapManager::buildLod(int level, int lod_x, int lod_y)
+{
+	static const int CHUNK_PIXELS = CHUNK_SIZE * TILE_SIZE;
+
+	LOD &lod = lods[level][lod_y * lods_x[level] + lod_x];
+	lod.dirty = false;
+
+	std::vector<RenderItem> items;
+
+	for (int layer = 0; layer < MAP_LAYERS; ++layer) {
+		items.clear();
+
+		// the four children, each lands on a quarter at half size
+		for (int j = 0; j < 2; ++j)
+			for (int i = 0; i < 2; ++i) {
+				int child_x = lod_x * 2 + i;
+				int child_y = lod_y * 2 + j;
+				TextureAccess *source;
 
-	return collision[pos_x][pos_y];
-}
+				if (level == 1) {
+					if (child_x >= chunks_x or child_y >= chunks_y)
+						continue;
 
-void MapManager::getSize(int *x, int *y)
-{
-	*x = tile.size();
+					CHUNK &chunk = chunks[child_y * chunks_x + child_x];
 
-	if (not tile.empty())
-		*y = tile[0].size();
-	else
-		*y = 0;
-}
+					if (not chunk.resident)
+						continue;
 
-void MapManager::render()
-{
-	for (int i = 0; i < tile.size(); ++i)
-		for (int j = 0; j < tile[i].size(); ++j) {
-			if (tile[i][j][0] != texture_manager->getMissingTexture())
-				renderer->addRenderItem(tile[i][j][0], i * TILE_SIZE, j * TILE_SIZE, false, false, 0);
+					if (chunk.dirty)
+						buildChunk(child_x, child_y);
 
-			if (tile[i][j][1] != texture_manager->getMissingTexture())
-				renderer->addRenderItem(tile[i][j][1], i * TILE_SIZE, j * TILE_SIZE, false, false, 2);
-		}
-}
+					source = &chunk.layer[layer];
+				} else {
+					if (child_x >= lods_x[level - 1] or child_y >= lods_y[level - 1])
+						continue;
 
-void MapManager::resizeMapStorage(int x, int y, bool absolute)
-{
-	// resize so that tile[x][y] is a valid position
-	++x; ++y;
-	int size_x, size_y;
+					LOD &child = lods[level - 1][child_y * lods_x[level - 1] + child_x];
 
-	if (absolute) {
-		size_x = x;
-		size_y = y;
-	} else {
-		size_x = tile.size() > x ? tile.size() : x;
+					if (child.dirty)
+						buildLod(level - 1, child_x, child_y);
 
-		if (not tile.empty())
-			size_y = tile[0].size() > y ? tile[0].size() : y;
-		else
-			size_y = y;
-	}
+					source = &child.layer[layer];
+				}
 
-	tile.resize(size_x);
-	collision.resize(size_x);
+				if ((*source)())
+					items.emplace_back(*source, i * CHUNK_PIXELS, j * CHUNK_PIXELS, false, false, 0, true);
+			}
 
-	for (int i = 0; i < size_x; ++i) {
-		tile[i].resize(size_y);
+		if (items.empty()) {
+			lod.layer[layer] = TextureAccess();
+			continue;
+		}
 
-		for (int j = 0; j < tile[i].size(); ++j)
-			tile[i][j].resize(2);
+		if (not lod.layer[layer]()) {
+			lod.layer[layer] = texture_manager->makeTarget(CHUNK_PIXELS, CHUNK_PIXELS);
+			setSmooth(lod.layer[layer]);
+		}
 
-		collision[i].resize(size_y, 1);
+		// filtered at half size, each pixel averages four below it
+		renderer->renderTo(lod.layer[layer], items, 0.5);
 	}
 }
 
+int MapManager::getLodLevel()
+{
+	// the chosen level is drawn between 1/2 and full size
+	double scale = renderer->getScale();
+	int level = 0;
+
+	while (level + 1 < LOD_LEVELS and scale <= 1.0 / (2 << level))
+		++level;
+
+	return level;
+}
+
 GameObject::GameObject(GameManager *parent) :
 	parent(parent),
 	renderer(parent->getRenderer()),
 	input_handler(parent->getManager()->getInputHandler()),
 	map_manager(parent->getMapManager()),
 	object_walker(nullptr),
+	animation(nullptr),
+	clips{},
 	current_frame(0),
-	loop_frame(0),
-	end_frame(0),
-	stop_frame(0),
 	dir(DOWN),
+	screen_x(0),
+	screen_y(0),
+	prev_x(0),
+	prev_y(0),
 	camera_center(false),
+	map_x(-1),
+	map_y(-1),
 	size_x(1),
 	size_y(1),
-	collision(false)
+	collision(false),
+	awake_index(-1),
+	unloaded(false),
+	source()
 {
 	// default position off screen
 	setMapPos(-1, -1, false);
-
-	// initialize textures with missing texture
-	TextureManager *texture_manager = renderer->getTextureManager();
-
-	up.resize(1);
-	down.resize(1);
-	side.resize(1);
-
-	/*
-	up[0] = texture_manager->getMissingTexture();
-	down[0] = texture_manager->getMissingTexture();
-	side[0] = texture_manager->getMissingTexture();
-	*/
 }
 
 GameObject::~GameObject()
@@ -210,6 +1058,12 @@ void GameObject::getCenter(int *x, int *y)
 	*y = screen_y + TILE_SIZE * size_y / 2;
 }
 
+void GameObject::getCenter(double alpha, int *x, int *y)
+{
+	*x = std::lround(prev_x + (screen_x - prev_x) * alpha) + TILE_SIZE * size_x / 2;
+	*y = std::lround(prev_y + (screen_y - prev_y) * alpha) + TILE_SIZE * size_y / 2;
+}
+
 bool GameObject::isCameraCenter()
 {
 	return camera_center;
@@ -217,9 +1071,14 @@ bool GameObject::isCameraCenter()
 
 void GameObject::setMapPos(int x, int y, bool anim)
 {
+	// move footprint in the object collision map
+	parent->removeCollision(this);
+
 	map_x = x;
 	map_y = y;
 
+	parent->addCollision(this);
+
 	// update ObjectWalker
 	if (object_walker)
 		object_walker->setDestination(map_x * TILE_SIZE, map_y * TILE_SIZE);
@@ -227,9 +1086,9 @@ void GameObject::setMapPos(int x, int y, bool anim)
 		anim = false;
 
 	if (not anim) {
-		// if not animating, move now
-		screen_x = map_x * TILE_SIZE;
-		screen_y = map_y * TILE_SIZE;
+		// if not animating, move now, without sliding there
+		screen_x = prev_x = map_x * TILE_SIZE;
+		screen_y = prev_y = map_y * TILE_SIZE;
 	}
 }
 
@@ -250,16 +1109,24 @@ bool GameObject::checkMapCollision(int offset_x, int offset_y)
 	int tmp_x = map_x + offset_x;
 	int tmp_y = map_y + offset_y;
 
-	//bool coll = false;
+	// whole footprint in one query
+	return map_manager->getCollision(tmp_x, tmp_y, size_x, size_y);
+}
 
-	for (int x = 0; x < size_x; ++x)
-		for (int y = 0; y < size_y; ++y)
-			//coll = coll or map_manager->getCollision(tmp_x + x, tmp_y + y);
-			if (map_manager->getCollision(tmp_x + x, tmp_y + y))
-				return true;
+bool GameObject::isAwake()
+{
+	// without a walker nothing ever moves it
+	return object_walker != nullptr;
+}
 
-	//return coll;
-	return false;
+bool GameObject::isObstacle()
+{
+	return collision and not object_walker;
+}
+
+bool GameObject::isUnloaded()
+{
+	return unloaded;
 }
 
 bool GameObject::checkObjectCollision(int offset_x, int offset_y)
@@ -283,22 +1150,50 @@ bool GameObject::checkObjectCollision(int offset_x, int offset_y)
 		return false;
 }
 
-void GameObject::render()
+void GameObject::getVelocity(int *x, int *y)
 {
-	switch (dir) {
-	case UP:
-		renderer->addRenderItem(up[current_frame], screen_x, screen_y, false, false, 1);
-		break;
-	case LEFT:
-		renderer->addRenderItem(side[current_frame], screen_x, screen_y, false, false, 1);
-		break;
-	case DOWN:
-		renderer->addRenderItem(down[current_frame], screen_x, screen_y, false, false, 1);
-		break;
-	case RIGHT:
-		renderer->addRenderItem(side[current_frame], screen_x, screen_y, true, false, 1);
-		break;
-	}
+	*x = screen_x - prev_x;
+	*y = screen_y - prev_y;
+}
+
+void GameObject::savePrevious()
+{
+	prev_x = screen_x;
+	prev_y = screen_y;
+}
+
+void GameObject::render(double alpha, std::vector<RenderItem> &items)
+{
+	if (not animation)
+		return;
+
+	// no refcount traffic, the set outlives the render item
+	const TextureAccess &sheet = animation->getSheet();
+
+	if (not sheet())
+		return;
+
+	const AnimationClip &clip = animation->getClip(clips[dir]);
+	const SDL_Rect &frame = clip.frames[std::min<size_t>(current_frame, clip.frames.size() - 1)].source;
+	bool flip = dir == RIGHT;
+
+	int draw_x = std::lround(prev_x + (screen_x - prev_x) * alpha);
+	int draw_y = std::lround(prev_y + (screen_y - prev_y) * alpha);
+
+	// skip objects outside the view, same margin as map tiles
+	static const int MARGIN = 2 * TILE_SIZE;
+
+	int view_x, view_y, view_w, view_h;
+	renderer->getView(&view_x, &view_y, &view_w, &view_h);
+
+	if (draw_x + frame.w < view_x - MARGIN or
+	    draw_y + frame.h < view_y - MARGIN or
+	    draw_x > view_x + view_w + MARGIN or
+	    draw_y > view_y + view_h + MARGIN)
+		return;
+
+	// the renderer adds the atlas offset, workers never touch the texture
+	items.emplace_back(sheet, frame, draw_x, draw_y, flip, false, 1);
 }
 
 bool GameObject::collide()
@@ -325,23 +1220,49 @@ void GameObject::_setScreenPos(int x, int y)
 void GameObject::advanceFrame(DIR dir)
 {
 	this->dir = dir;
-	if (++current_frame > end_frame) {
-		current_frame = loop_frame;
+
+	if (not animation)
+		return;
+
+	// also catches frames left over from a longer clip
+	const AnimationClip &clip = animation->getClip(clips[dir]);
+	if (++current_frame > clip.end_frame) {
+		current_frame = clip.loop_frame;
 	}
 }
 
 void GameObject::stopFrame(DIR dir)
 {
+	if (not animation)
+		return;
+
+	const AnimationClip &clip = animation->getClip(clips[this->dir]);
+
 	//this->dir = dir;
 	//current_frame = current_frame != stop_frame ? stop_frame : 0;
-	if (current_frame != stop_frame and current_frame != 0)
-		current_frame = stop_frame;
+	if (current_frame != clip.stop_frame and current_frame != 0)
+		current_frame = clip.stop_frame;
 	else if (current_frame != 0)
 		current_frame = 0;
 }
 
+uint64_t GameObject::getFrameTime()
+{
+	if (not animation)
+		return 0;
+
+	const AnimationClip &clip = animation->getClip(clips[dir]);
+	return clip.frames[std::min<size_t>(current_frame, clip.frames.size() - 1)].time;
+}
+
 ObjectWalker::ObjectWalker(GameObject *parent) :
-	parent(parent)
+	parent(parent),
+	dest_x(0),
+	dest_y(0),
+	tick(0),
+	movement_deadline(0),
+	animation_deadline(0),
+	path_next(0)
 {
 	/* 
 	 * useless, since constructor will set correct values
@@ -356,8 +1277,62 @@ void ObjectWalker::setDestination(int x, int y)
 	dest_y = y;
 
 	// respond instantly to new destination
-	movement_deadline = 0;
-	animation_deadline = 0;
+	movement_deadline = tick;
+	animation_deadline = tick;
+}
+
+GameObject *ObjectWalker::getParent()
+{
+	return parent;
+}
+
+bool ObjectWalker::isArrived()
+{
+	int x, y;
+	parent->getScreenPos(&x, &y);
+
+	return x == dest_x and y == dest_y;
+}
+
+void ObjectWalker::setPath(std::vector<WAYPOINT> path)
+{
+	this->path = std::move(path);
+	path_next = 0;
+}
+
+void ObjectWalker::clearPath()
+{
+	path.clear();
+	path_next = 0;
+}
+
+bool ObjectWalker::hasPath()
+{
+	return path_next < path.size();
+}
+
+void ObjectWalker::followPath()
+{
+	int map_x, map_y;
+	parent->getMapPos(&map_x, &map_y);
+
+	WAYPOINT next = path[path_next];
+	int offset_x = next.x - map_x;
+	int offset_y = next.y - map_y;
+
+	// something moved in the way or the path went stale
+	if (std::abs(offset_x) + std::abs(offset_y) != 1 or
+	    parent->checkMapCollision(offset_x, offset_y) or
+	    parent->checkObjectCollision(offset_x, offset_y)) {
+		clearPath();
+		return;
+	}
+
+	++path_next;
+	parent->setMapPos(next.x, next.y);
+
+	if (path_next == path.size())
+		clearPath();
 }
 
 /*
@@ -371,7 +1346,12 @@ void ObjectWalker::runTick(uint64_t delta)
 {
 	tick += delta;
 
-	if (movement_deadline < tick) {
+	// next step starts the tick the last one ends
+	if (hasPath() and isArrived())
+		followPath();
+
+	// one pixel per SPEED ms, however long the step was
+	while (movement_deadline < tick) {
 		// temporary screen coords
 		int tmp_x, tmp_y;
 		// invert move direction
@@ -414,17 +1394,18 @@ void ObjectWalker::runTick(uint64_t delta)
 		// send screen position to object
 		parent->setScreenPos(tmp_x, tmp_y, false);
 
-		movement_deadline = tick + SPEED;
-
 		// send animation data to object
-		if (animation_deadline < tick) {
+		if (animation_deadline <= movement_deadline) {
 			if (sgn_x == 0 and sgn_y == 0)
 				parent->stopFrame(dir);
 			else
 				parent->advanceFrame(dir);
 
-			animation_deadline = tick + FRAME_TIME;
+			uint64_t frame_time = parent->getFrameTime();
+			animation_deadline = movement_deadline + (frame_time ? frame_time : FRAME_TIME);
 		}
+
+		movement_deadline += SPEED;
 	}
 }
 
@@ -446,117 +1427,83 @@ Player::Player(GameManager *parent, int type) :
 	collision = true;
 
 	// load spawn location
+	spawn();
+
+	// every frame is cut from one sheet per character
+	animation = parent->loadAnimation(type == 0
+	                                  ? "data/sprite/mc_male/animation.txt"
+	                                  : "data/sprite/mc_female/animation.txt");
+
+	const char *names[DIR_SIZE];
+	names[UP] = "up";
+	names[LEFT] = "side";
+	names[DOWN] = "down";
+	names[RIGHT] = "side";
+
+	for (int i = 0; i < DIR_SIZE; ++i) {
+		clips[i] = animation->findClip(names[i]);
+
+		if (clips[i] < 0)
+			throw std::runtime_error(std::string("player animation has no ") + names[i] + " clip");
+	}
+}
+
+void Player::spawn()
+{
 	int tmp_x, tmp_y;
 	map_manager->getSpawn(&tmp_x, &tmp_y);
 	setMapPos(tmp_x, tmp_y, false);
 
-	// load textures
-	// TODO: load male/female based on choice
-	// TODO: improve texture loading logic
-
-	TextureManager *texture_manager = renderer->getTextureManager();
+	if (type == 0)
+		return;
 
-	/*
-	 * keep all frames in order
-	 * even if duplicated
-	 * pointers don't take much memory
-	 * and it simplifies code massively
-	 */
+	// both are solid, overlapping would lock them in place
+	const int offsets[][2] = {{size_x, 0}, {-size_x, 0}, {0, size_y}, {0, -size_y}};
 
-	// set ObjectWalker frames
-	loop_frame = 1;
-	end_frame = 4;
-	stop_frame = 5;
-
-	up.resize(stop_frame + 1);
-	down.resize(stop_frame + 1);
-	side.resize(stop_frame + 1);
-
-	switch (type) {
-	case 0:
-		up[0] = texture_manager->loadTexture("data/sprite/mc_male/u.png");
-		up[1] = texture_manager->loadTexture("data/sprite/mc_male/u1.png");
-		up[2] = texture_manager->loadTexture("data/sprite/mc_male/u.png");
-		up[3] = texture_manager->loadTexture("data/sprite/mc_male/u2.png");
-		up[4] = texture_manager->loadTexture("data/sprite/mc_male/u.png");
-		up[5] = texture_manager->loadTexture("data/sprite/mc_male/u.png");
-
-		down[0] = texture_manager->loadTexture("data/sprite/mc_male/d.png");
-		down[1] = texture_manager->loadTexture("data/sprite/mc_male/d1.png");
-		down[2] = texture_manager->loadTexture("data/sprite/mc_male/d.png");
-		down[3] = texture_manager->loadTexture("data/sprite/mc_male/d2.png");
-		down[4] = texture_manager->loadTexture("data/sprite/mc_male/d.png");
-		down[5] = texture_manager->loadTexture("data/sprite/mc_male/d.png");
-
-		side[0] = texture_manager->loadTexture("data/sprite/mc_male/s.png");
-		side[1] = texture_manager->loadTexture("data/sprite/mc_male/s1.png");
-		side[2] = texture_manager->loadTexture("data/sprite/mc_male/s.png");
-		side[3] = texture_manager->loadTexture("data/sprite/mc_male/s2.png");
-		side[4] = texture_manager->loadTexture("data/sprite/mc_male/s.png");
-		side[5] = texture_manager->loadTexture("data/sprite/mc_male/s3.png");
-
-		break;
-
-	case 1:
-		up[0] = texture_manager->loadTexture("data/sprite/mc_female/u.png");
-		up[1] = texture_manager->loadTexture("data/sprite/mc_female/u1.png");
-		up[2] = texture_manager->loadTexture("data/sprite/mc_female/u.png");
-		up[3] = texture_manager->loadTexture("data/sprite/mc_female/u2.png");
-		up[4] = texture_manager->loadTexture("data/sprite/mc_female/u.png");
-		up[5] = texture_manager->loadTexture("data/sprite/mc_female/u.png");
-
-		down[0] = texture_manager->loadTexture("data/sprite/mc_female/d.png");
-		down[1] = texture_manager->loadTexture("data/sprite/mc_female/d1.png");
-		down[2] = texture_manager->loadTexture("data/sprite/mc_female/d.png");
-		down[3] = texture_manager->loadTexture("data/sprite/mc_female/d2.png");
-		down[4] = texture_manager->loadTexture("data/sprite/mc_female/d.png");
-		down[5] = texture_manager->loadTexture("data/sprite/mc_female/d.png");
-
-		side[0] = texture_manager->loadTexture("data/sprite/mc_female/s.png");
-		side[1] = texture_manager->loadTexture("data/sprite/mc_female/s1.png");
-		side[2] = texture_manager->loadTexture("data/sprite/mc_female/s.png");
-		side[3] = texture_manager->loadTexture("data/sprite/mc_female/s2.png");
-		side[4] = texture_manager->loadTexture("data/sprite/mc_female/s.png");
-		side[5] = texture_manager->loadTexture("data/sprite/mc_female/s3.png");
-
-		break;
-	}
+	for (auto &offset : offsets)
+		if (not checkMapCollision(offset[0], offset[1])) {
+			setMapPos(tmp_x + offset[0], tmp_y + offset[1], false);
+			return;
+		}
 }
 
 void Player::runTick(uint64_t delta)
 {
+	// keys take over from a clicked path
+	for (int dir = 0; dir < DIR_SIZE; ++dir)
+		if (input_handler->isHeld(ACTION(dir), type) or input_handler->isPressed(ACTION(dir), type))
+			object_walker->clearPath();
+
 	// run base class tick
 	GameObject::runTick(delta);
 
-	// get input
-	if (current_frame == 0 or 
-	    current_frame == stop_frame) {
-		if (((input_handler->isPlayer(UP) and type == 0) or 
-		    (input_handler->isPlayer2(UP) and type == 1)) and
+	/*
+	 * get input once the last step is done, the same tick it ends,
+	 * keys tapped during the step are latched until then
+	 */
+	if (object_walker->isArrived()) {
+		if (input_handler->consume(ACTION_UP, type) and
 		    not checkMapCollision(0, -1) and
 		    not checkObjectCollision(0, -1)) {
 			setMapPos(map_x, map_y - 1);
 			//return;
 		}
 
-		if (((input_handler->isPlayer(RIGHT) and type == 0) or
-		    (input_handler->isPlayer2(RIGHT) and type == 1)) and
+		if (input_handler->consume(ACTION_RIGHT, type) and
 		    not checkMapCollision(1, 0) and
 		    not checkObjectCollision(1, 0)) {
 			setMapPos(map_x + 1, map_y);
 			//return;
 		}
 
-		if (((input_handler->isPlayer(DOWN) and type == 0) or
-		    (input_handler->isPlayer2(DOWN) and type == 1)) and
+		if (input_handler->consume(ACTION_DOWN, type) and
 		    not checkMapCollision(0, 1) and
 		    not checkObjectCollision(0, 1)) {
 			setMapPos(map_x, map_y + 1);
 			//return;
 		}
 
-		if (((input_handler->isPlayer(LEFT) and type == 0) or
-		    (input_handler->isPlayer2(LEFT) and type == 1)) and
+		if (input_handler->consume(ACTION_LEFT, type) and
 		    not checkMapCollision(-1, 0) and
 		    not checkObjectCollision(-1, 0)) {
 			setMapPos(map_x - 1, map_y);
@@ -578,11 +1525,7 @@ StaticObject::StaticObject(
 	setMapPos(map_x, map_y, false);
 
 	TextureManager *texture_manager = renderer->getTextureManager();
-	auto tex = texture_manager->loadTexture(texture_path);
-
-	up[0] = tex;
-	down[0] = tex;
-	side[0] = tex;
+	animation = std::make_shared<AnimationSet>(texture_manager->loadTexture(texture_path));
 }
 
 PickupObject::PickupObject(
@@ -600,11 +1543,7 @@ PickupObject::PickupObject(
 	setMapPos(map_x, map_y, false);
 
 	TextureManager *texture_manager = renderer->getTextureManager();
-	auto tex = texture_manager->loadTexture(texture_path);
-
-	up[0] = tex;
-	down[0] = tex;
-	side[0] = tex;
+	animation = std::make_shared<AnimationSet>(texture_manager->loadTexture(texture_path));
 
 	parent->addCollectible();
 }
@@ -632,7 +1571,7 @@ QuizManager::QuizManager(GameManager *parent) :
 	have_answer(false)
 {
 	// TODO: implement
-	std::ifstream question_file("data/questions.txt");
+	std::istringstream question_file(FileSystem::read("data/questions.txt"));
 
 	QUESTION temp;
 	temp.answers.resize(3);
@@ -715,10 +1654,15 @@ GameManager::GameManager(Manager *parent) :
 	renderer(parent->getRenderer()),
 	map_manager(this),
 	quiz_manager(this),
+	path_finder(this),
+	second_player(nullptr),
+	zoom(1),
+	prev_zoom(1),
 	playtime(0),
 	paused(false),
 	collectibles(0),
-	collected(0)
+	collected(0),
+	hint_version(0)
 {
 	// set renderer size
 	// aspect ratio is 4:3 for classy feel
@@ -726,11 +1670,16 @@ GameManager::GameManager(Manager *parent) :
 	renderer->setSize(4 * multiplier * TILE_SIZE, 3 * multiplier * TILE_SIZE);
 
 	// player should always be first object
-	objects.push_back(new Player(this, 0));
-	//objects.push_back(new Player(this, 1));
+	player = players.create(this, 0);
+	addObject(player);
+
+	if (parent->isTwoPlayers()) {
+		second_player = players.create(this, 1);
+		addObject(second_player);
+	}
 	
 	// load first hint
-	std::ifstream firsthint("data/firsthint.txt");
+	std::istringstream firsthint(FileSystem::read("data/firsthint.txt"));
 	std::string hint;
 	std::getline(firsthint, hint);
 	hints.push_back(hint);
@@ -741,8 +1690,8 @@ GameManager::GameManager(Manager *parent) :
 
 GameManager::~GameManager()
 {
-	for (auto obj : objects)
-		delete obj;
+	// pools free the objects themselves
+	flushGraveyard();
 }
 
 Manager *GameManager::getManager()
@@ -765,19 +1714,38 @@ QuizManager *GameManager::getQuizManager()
 	return &quiz_manager;
 }
 
-Player *GameManager::getPlayer()
+PathFinder *GameManager::getPathFinder()
 {
-	return static_cast<Player *>(objects.front());
+	return &path_finder;
+}
+
+Player *GameManager::getPlayer(int type)
+{
+	return type == 0 ? player : type == 1 ? second_player : nullptr;
+}
+
+std::shared_ptr<AnimationSet> GameManager::loadAnimation(const std::filesystem::path &path)
+{
+	auto found = animations.find(path.native());
+	if (found != animations.end())
+		return found->second;
+
+	auto animation = std::make_shared<AnimationSet>(renderer->getTextureManager(), path);
+	animations.emplace(path.native(), animation);
+
+	return animation;
 }
 
 void GameManager::loadObject(std::filesystem::path object_path, int map_x, int map_y)
 {
-	std::ifstream object_file(object_path);
+	std::istringstream object_file(FileSystem::read(object_path));
 
 	// get object type
 	std::string type;
 	object_file >> type;
 
+	GameObject *object = nullptr;
+
 	// load data based on type
 	if (type == "static") {
 		std::filesystem::path tex;
@@ -785,7 +1753,7 @@ void GameManager::loadObject(std::filesystem::path object_path, int map_x, int m
 
 		object_file >> tex >> size_x >> size_y;
 
-		objects.push_back(new StaticObject(this, tex, size_x, size_y, map_x, map_y));
+		object = statics.create(this, tex, size_x, size_y, map_x, map_y);
 	} else if (type == "pickup") {
 		std::filesystem::path tex;
 		int size_x, size_y;
@@ -794,69 +1762,174 @@ void GameManager::loadObject(std::filesystem::path object_path, int map_x, int m
 		object_file >> tex >> size_x >> size_y >> std::ws;
 		std::getline(object_file, hint);
 
-		objects.push_back(new PickupObject(this, tex, size_x, size_y, map_x, map_y, hint));
+		object = pickups.create(this, tex, size_x, size_y, map_x, map_y, hint);
 	}
 
 	// TODO: add more types
 
-	// update collision
+	if (object) {
+		object->source = object_path;
+		addObject(object);
+	}
+
+	/*
+	 * new objects stamped themselves on setMapPos,
+	 * this only matters when the map size changed
+	 */
 	updateCollision();
 }
 
 void GameManager::unloadObject(GameObject *object)
 {
-	auto it = std::find(objects.begin(), objects.end(), object);
+	if (object->unloaded)
+		return;
+
+	// gone from the world now, memory goes after the tick
+	object->unloaded = true;
+	removeCollision(object);
+
+	if (object->object_walker)
+		path_finder.cancel(object->object_walker);
+	graveyard.push_back(object);
+}
+
+bool GameManager::unloadMapObject(const std::filesystem::path &source, int map_x, int map_y)
+{
+	GameObject *found = nullptr;
+	bool pickup = false;
+
+	auto match = [&](GameObject *object) {
+		if (not found and not object->unloaded and object->source == source and
+		    object->map_x == map_x and object->map_y == map_y)
+			found = object;
+	};
 
-	if (it != objects.end()) {
-		objects.erase(it);
+	statics.forEach(match);
 
-		// update collision
-		updateCollision();
+	if (not found) {
+		pickups.forEach(match);
+		pickup = found != nullptr;
 	}
+
+	// collected pickups are gone already
+	if (not found)
+		return false;
+
+	// no longer there to be collected
+	if (pickup)
+		--collectibles;
+
+	unloadObject(found);
+	return true;
 }
 
-void GameManager::updateCollision()
+void GameManager::clearObjects()
 {
-	// make sure object collision map size is correct
-	{
-		int size_x, size_y;
-		map_manager.getSize(&size_x, &size_y);
+	forEachObject([this](GameObject *object) {
+		if (object != player and object != second_player)
+			unloadObject(object);
+	});
+}
+
+void GameManager::wakeObject(GameObject *object)
+{
+	if (object->awake_index >= 0 or object->unloaded)
+		return;
+
+	object->awake_index = awake.size();
+	awake.push_back(object);
+}
 
-		collision.resize(size_x);
+void GameManager::sleepObject(GameObject *object)
+{
+	if (object->awake_index < 0)
+		return;
+
+	// swap with the last one, order does not matter
+	awake[object->awake_index] = awake.back();
+	awake[object->awake_index]->awake_index = object->awake_index;
+	awake.pop_back();
+
+	object->awake_index = -1;
+}
+
+void GameManager::addObject(GameObject *object)
+{
+	if (object->isAwake())
+		wakeObject(object);
+}
 
-		for(int i = 0; i < collision.size(); ++i)
-			collision[i].resize(size_y);
+void GameManager::flushGraveyard()
+{
+	for (auto object : graveyard) {
+		sleepObject(object);
+
+		if (auto it = dynamic_cast<Player *>(object))
+			players.destroy(it);
+		else if (auto it = dynamic_cast<StaticObject *>(object))
+			statics.destroy(it);
+		else if (auto it = dynamic_cast<PickupObject *>(object))
+			pickups.destroy(it);
 	}
 
-	// construct up to date collision map
-	for(int i = 0; i < collision.size(); ++i)
-		for(int j = 0; j < collision[i].size(); ++j)
-			collision[i][j] = nullptr;
+	graveyard.clear();
+}
+
+void GameManager::updateCollision()
+{
+	int size_x, size_y;
+	map_manager.getSize(&size_x, &size_y);
+
+	// nothing to do unless the map size changed
+	if (collision.getWidth() == size_x and collision.getHeight() == size_y)
+		return;
+
+	collision.resize(size_x, size_y, nullptr);
+
+	forEachObject([this](GameObject *object) {
+		addCollision(object);
+	});
+}
 
-	for (auto obj : objects) {
-		int map_x, map_y, size_x, size_y;
+void GameManager::addCollision(GameObject *object)
+{
+	int map_x, map_y, size_x, size_y;
 
-		obj->getMapPos(&map_x, &map_y);
-		obj->getSize(&size_x, &size_y);
+	object->getMapPos(&map_x, &map_y);
+	object->getSize(&size_x, &size_y);
 
+	for(int j = map_y; j < map_y + size_y; ++j)
 		for(int i = map_x; i < map_x + size_x; ++i)
-			for(int j = map_y; j < map_y + size_y; ++j) {
-				if (i < 0 or i >= collision.size() or
-				    j < 0 or j >= collision[i].size())
-					continue;
+			if (collision.contains(i, j))
+				collision(i, j) = object;
 
-				collision[i][j] = obj;	
-			}
-	}
+	if (object->isObstacle())
+		path_finder.invalidate(map_x, map_y, size_x, size_y);
+}
+
+void GameManager::removeCollision(GameObject *object)
+{
+	int map_x, map_y, size_x, size_y;
+
+	object->getMapPos(&map_x, &map_y);
+	object->getSize(&size_x, &size_y);
+
+	// leave cells another object stamped over alone
+	for(int j = map_y; j < map_y + size_y; ++j)
+		for(int i = map_x; i < map_x + size_x; ++i)
+			if (collision.contains(i, j) and collision(i, j) == object)
+				collision(i, j) = nullptr;
+
+	if (object->isObstacle())
+		path_finder.invalidate(map_x, map_y, size_x, size_y);
 }
 
 GameObject *GameManager::getCollision(int pos_x, int pos_y)
 {
-	if (pos_x < 0 or pos_x >= collision.size() or 
-	    pos_y < 0 or pos_y >= collision[pos_x].size())
+	if (not collision.contains(pos_x, pos_y))
 		return nullptr;
 	
-	return collision[pos_x][pos_y];
+	return collision(pos_x, pos_y);
 }
 
 uint64_t GameManager::getPlaytime()
@@ -905,12 +1978,18 @@ void GameManager::useCollectible()
 void GameManager::addHint(std::string hint)
 {
 	hints.push_back(hint);
+	++hint_version;
 
 	// do not keep all hints
 	while (hints.size() > 1)
 		hints.pop_front();
 }
 
+unsigned int GameManager::getHintVersion()
+{
+	return hint_version;
+}
+
 std::list<std::string> GameManager::getHints()
 {
 	return hints;
@@ -922,60 +2001,190 @@ void GameManager::runTick(uint64_t delta)
 	if (not paused)
 		playtime += delta;
 
-	// update collision map
+	Profiler *profiler = parent->getProfiler();
+
+	// only does work after the map size changed
+	profiler->begin(PHASE_COLLISION);
 	updateCollision();
+	profiler->end(PHASE_COLLISION);
 
-	// render map tiles
-	map_manager.render();
+	profiler->begin(PHASE_PATH);
 
-	// calculate camera center
-	int camera_count = 0;
-	int camera_x = 0;
-	int camera_y = 0;
-	// calculate map size to include everything
+	// click to walk, the first step starts this tick
+	int click_x, click_y;
+	if (parent->getInputHandler()->consumeClick(&click_x, &click_y) and not paused) {
+		int view_x, view_y, view_w, view_h;
+		renderer->getView(&view_x, &view_y, &view_w, &view_h);
+
+		// clicks are in logical pixels, the view may be zoomed
+		int world_x = view_x + int(click_x / renderer->getScale());
+		int world_y = view_y + int(click_y / renderer->getScale());
+
+		if (world_x >= 0 and world_y >= 0)
+			path_finder.request(player->object_walker, world_x / TILE_SIZE, world_y / TILE_SIZE);
+	}
+
+	path_finder.runBatch();
+	profiler->end(PHASE_PATH);
+
+	profiler->begin(PHASE_OBJECTS);
+
+	// by index, ticks may wake objects and grow the list
+	for (size_t i = 0; i < awake.size(); ++i) {
+		GameObject *obj = awake[i];
+
+		if (obj->unloaded)
+			continue;
+
+		obj->savePrevious();
+
+		// run object tick
+		if (not paused)
+			obj->runTick(delta);
+	}
+
+	flushGraveyard();
+	profiler->end(PHASE_OBJECTS);
+
+	// update quiz if needed
+	profiler->begin(PHASE_QUIZ);
+	quiz_manager.runTick(delta);
+	profiler->end(PHASE_QUIZ);
+
+	updateZoom(delta);
+}
+
+void GameManager::updateZoom(uint64_t delta)
+{
 	int min_x = std::numeric_limits<int>::max();
 	int min_y = std::numeric_limits<int>::max();
 	int max_x = std::numeric_limits<int>::min();
 	int max_y = std::numeric_limits<int>::min();
 
-	for (auto obj : objects) {
-		// run object tick
-		if (not paused)
-			obj->runTick(delta);
-		obj->render();
+	// only players centre the camera, the rest is not walked every tick
+	players.forEach([&](GameObject *obj) {
+		if (obj->isUnloaded() or not obj->isCameraCenter())
+			return;
+
+		int tmp_x, tmp_y;
+		obj->getCenter(1, &tmp_x, &tmp_y);
+
+		min_x = std::min(min_x, tmp_x);
+		min_y = std::min(min_y, tmp_y);
+		max_x = std::max(max_x, tmp_x);
+		max_y = std::max(max_y, tmp_y);
+	});
+
+	double target = 1;
+
+	// the view is centred between them, so the spread is what has to fit
+	if (min_x <= max_x) {
+		int width, height;
+		renderer->getSize(&width, &height);
+
+		target = std::min({
+			1.0,
+			double(width) / (max_x - min_x + 2 * ZOOM_MARGIN),
+			double(height) / (max_y - min_y + 2 * ZOOM_MARGIN)
+		});
+	}
+
+	// compounded over the step, so more steps a second ease as fast
+	double rate = 1 - std::pow(1 - ZOOM_RATE, double(delta) / ZOOM_RATE_TIME);
+
+	prev_zoom = zoom;
+	zoom += (std::max(target, ZOOM_MIN) - zoom) * rate;
+}
+
+void GameManager::render(double alpha)
+{
+	beginRender(alpha);
+	endRender();
+}
 
+void GameManager::beginRender(double alpha)
+{
+	// calculate camera center
+	int camera_count = 0;
+	int camera_x = 0;
+	int camera_y = 0;
+
+	std::vector<MapManager::CAMERA> cameras;
+
+	forEachObject([&](GameObject *obj) {
 		// camera calculations
 		if (obj->isCameraCenter()) {
 			int tmp_x, tmp_y;
+			int vel_x, vel_y;
 
-			obj->getCenter(&tmp_x, &tmp_y);
+			obj->getCenter(alpha, &tmp_x, &tmp_y);
+			obj->getVelocity(&vel_x, &vel_y);
+			cameras.push_back({tmp_x, tmp_y, vel_x, vel_y});
 
 			camera_count++;
 			camera_x += tmp_x;
 			camera_y += tmp_y;
-
-			min_x = std::min(min_x, tmp_x);
-			min_y = std::min(min_y, tmp_y);
-			max_x = std::max(max_x, tmp_x);
-			max_y = std::max(max_y, tmp_y);
 		}
-	}
+	});
 
 	if (camera_count > 0) {
 		camera_x /= camera_count;
 		camera_y /= camera_count;
 	}
 
-	//int size_x = std::abs(max_x - min_x);
-	//int size_y = std::abs(max_y - min_y);
-	//int multiplier = 5;
+	// the logical size stays, the ui keeps its layout
+	renderer->setCenter(camera_x, camera_y);
+	renderer->setScale(prev_zoom + (zoom - prev_zoom) * alpha);
 
-	//while (4 * multiplier * TILE_SIZE < size_x and 3 * multiplier * TILE_SIZE < size_y) 
-		//++multiplier;
+	Profiler *profiler = parent->getProfiler();
 
-	renderer->setCenter(camera_x, camera_y);
-	//renderer->setSize(4 * multiplier * TILE_SIZE, 3 * multiplier * TILE_SIZE);
-	
-	// update quiz if needed
-	quiz_manager.runTick(delta);
+	// render map tiles, culled against the camera set above
+	profiler->begin(PHASE_MAP);
+	map_manager.stream(cameras);
+	map_manager.render();
+	profiler->end(PHASE_MAP);
+
+	profiler->begin(PHASE_DRAW);
+
+	render_objects.clear();
+	forEachObject([this](GameObject *obj) {
+		render_objects.push_back(obj);
+	});
+
+	size_t ranges = (render_objects.size() + RENDER_GRAIN - 1) / RENDER_GRAIN;
+
+	if (render_items.size() < ranges)
+		render_items.resize(ranges);
+
+	JobSystem *jobs = parent->getJobs();
+
+	for (size_t i = 0; i < ranges; ++i) {
+		render_items[i].clear();
+
+		jobs->submit(render_jobs, [this, i, alpha]() {
+			size_t end = std::min(render_objects.size(), (i + 1) * RENDER_GRAIN);
+
+			for (size_t j = i * RENDER_GRAIN; j < end; ++j)
+				render_objects[j]->render(alpha, render_items[i]);
+		});
+	}
+
+	profiler->end(PHASE_DRAW);
+}
+
+void GameManager::endRender()
+{
+	Profiler *profiler = parent->getProfiler();
+	profiler->begin(PHASE_DRAW);
+
+	parent->getJobs()->wait(render_jobs);
+
+	// in object order, same as drawing them one by one
+	size_t ranges = (render_objects.size() + RENDER_GRAIN - 1) / RENDER_GRAIN;
+
+	for (size_t i = 0; i < ranges; ++i)
+		for (auto &item : render_items[i])
+			renderer->addRenderItem(item);
+
+	profiler->end(PHASE_DRAW);
 }
@@ -0,0 +1,98 @@
+#include "grid.h"
+
+#include <algorithm>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+BitGrid::BitGrid(int width, int height, bool value)
+{
+	resize(width, height, value);
+}
+
+void BitGrid::resize(int width, int height, bool value)
+{
+	this->width = width;
+	this->height = height;
+	stride = (width + 63) / 64;
+	words.assign(stride * height, value ? ~uint64_t(0) : 0);
+}
+
+int BitGrid::getWidth() const
+{
+	return width;
+}
+
+int BitGrid::getHeight() const
+{
+	return height;
+}
+
+size_t BitGrid::getStride() const
+{
+	return stride;
+}
+
+bool BitGrid::get(int x, int y) const
+{
+	if (x < 0 or y < 0 or x >= width or y >= height)
+		return false;
+
+	return (words[y * stride + x / 64] >> (x % 64)) & 1;
+}
+
+void BitGrid::set(int x, int y, bool value)
+{
+	if (x < 0 or y < 0 or x >= width or y >= height)
+		return;
+
+	uint64_t bit = uint64_t(1) << (x % 64);
+
+	if (value)
+		words[y * stride + x / 64] |= bit;
+	else
+		words[y * stride + x / 64] &= ~bit;
+}
+
+bool BitGrid::any(int x, int y, int size_x, int size_y, bool outside) const
+{
+	if (size_x <= 0 or size_y <= 0)
+		return false;
+
+	int begin_x = std::max(x, 0);
+	int begin_y = std::max(y, 0);
+	int end_x = std::min(x + size_x, width);
+	int end_y = std::min(y + size_y, height);
+
+	if (outside and (begin_x != x or begin_y != y or
+	                 end_x != x + size_x or end_y != y + size_y))
+		return true;
+
+	if (begin_x >= end_x or begin_y >= end_y)
+		return false;
+
+	for (int j = begin_y; j < end_y; ++j) {
+		const uint64_t *row = words.data() + j * stride;
+
+		for (int word = begin_x / 64; word <= (end_x - 1) / 64; ++word) {
+			// bits of this word inside [begin_x, end_x)
+			int low = std::max(begin_x - word * 64, 0);
+			int high = std::min(end_x - word * 64, 64);
+
+			uint64_t mask = high - low == 64
+			                ? ~uint64_t(0)
+			                : ((uint64_t(1) << (high - low)) - 1) << low;
+
+			if (row[word] & mask)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+uint64_t *BitGrid::getRow(int y)
+{
+	return words.data() + y * stride;
+}
@@ -1,5 +1,7 @@
 #include "input.h"
 
+#include <stdexcept>
+
 #ifdef __unix__
 #include <SDL2/SDL.h>
 #elif _WIN32
@@ -9,15 +11,70 @@
 #error Unsupported platform
 #endif
 
+static_assert(ACTION_SIZE <= 32, "actions must fit the player masks");
+
+/*
+ * for list of available keycodes:
+ * https://wiki.libsdl.org/SDL_Keycode
+ *
+ * wasd always moves player 1, the arrows move player 1
+ * alone and player 2 once there are two
+ */
+static const struct BINDING {
+	int32_t key;
+	int player;
+	ACTION action;
+	// active with this many players, 0 for any
+	int players;
+} BINDINGS[] = {
+	{SDLK_w, 0, ACTION_UP, 0},
+	{SDLK_a, 0, ACTION_LEFT, 0},
+	{SDLK_s, 0, ACTION_DOWN, 0},
+	{SDLK_d, 0, ACTION_RIGHT, 0},
+
+	{SDLK_UP, 0, ACTION_UP, 1},
+	{SDLK_LEFT, 0, ACTION_LEFT, 1},
+	{SDLK_DOWN, 0, ACTION_DOWN, 1},
+	{SDLK_RIGHT, 0, ACTION_RIGHT, 1},
+
+	{SDLK_UP, 1, ACTION_UP, 2},
+	{SDLK_LEFT, 1, ACTION_LEFT, 2},
+	{SDLK_DOWN, 1, ACTION_DOWN, 2},
+	{SDLK_RIGHT, 1, ACTION_RIGHT, 2},
+
+	{SDLK_ESCAPE, 0, ACTION_PAUSE, 0},
+	{SDLK_p, 0, ACTION_PAUSE, 0},
+	{SDLK_RETURN, 0, ACTION_ENTER, 0},
+	{SDLK_F3, 0, ACTION_DEBUG, 0},
+	{SDLK_1, 0, ACTION_ANSWER_1, 0},
+	{SDLK_2, 0, ACTION_ANSWER_2, 0},
+	{SDLK_3, 0, ACTION_ANSWER_3, 0},
+};
+
+static const size_t BINDING_COUNT = sizeof(BINDINGS) / sizeof(BINDINGS[0]);
+
+static_assert(BINDING_COUNT <= 64, "bindings must fit bindings_down");
+
 InputHandler::InputHandler() :
 	quit(false),
-	player(DIR_SIZE),
-	player2(DIR_SIZE),
-	answer(3)
+	render_resets(0),
+	player_count(1),
+	players(),
+	bindings_down(0),
+	click(false),
+	click_x(0),
+	click_y(0),
+	queue(),
+	queue_end(0)
 {}
 
 void InputHandler::processEvents()
 {
+	for (auto &it : players) {
+		it.pressed = 0;
+		it.released = 0;
+	}
+
 	SDL_Event event;
 
 	while (SDL_PollEvent(&event))
@@ -26,155 +83,208 @@ void InputHandler::processEvents()
 			quit = true;
 			break;
 
-		/*
-		 * for list of available keycodes:
-		 * https://wiki.libsdl.org/SDL_Keycode
-		 */
-		case SDL_KEYDOWN: {
-			switch (event.key.keysym.sym) {
-			case SDLK_ESCAPE:
-			case SDLK_p:
-				pause = true;
-				break;
+		case SDL_RENDER_TARGETS_RESET:
+		case SDL_RENDER_DEVICE_RESET:
+			++render_resets;
+			break;
 
-			case SDLK_UP:
-				player2[UP] = true;
-			case SDLK_w:
-				player[UP] = true;
-				break;
+		// key ups go to whatever has focus now
+		case SDL_WINDOWEVENT:
+			if (event.window.event == SDL_WINDOWEVENT_FOCUS_LOST)
+				releaseAll(event.window.timestamp);
+			break;
 
-			case SDLK_RIGHT:
-				player2[RIGHT] = true;
-			case SDLK_d:
-				player[RIGHT] = true;
-				break;
+		// the renderer scales these to its logical size
+		case SDL_MOUSEBUTTONDOWN:
+			if (event.button.button == SDL_BUTTON_LEFT) {
+				click = true;
+				click_x = event.button.x;
+				click_y = event.button.y;
+			}
+			break;
 
-			case SDLK_DOWN:
-				player2[DOWN] = true;
-			case SDLK_s:
-				player[DOWN] = true;
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+			// held already, repeats are no new press
+			if (event.key.repeat)
 				break;
 
-			case SDLK_LEFT:
-				player2[LEFT] = true;
-			case SDLK_a:
-				player[LEFT] = true;
-				break;
+			for (size_t i = 0; i < BINDING_COUNT; ++i)
+				if (BINDINGS[i].key == event.key.keysym.sym and
+				    (BINDINGS[i].players == 0 or BINDINGS[i].players == player_count))
+					setBinding(i, event.type == SDL_KEYDOWN, event.key.timestamp);
 
-			case SDLK_RETURN:
-				enter = true;
-				break;
+			break;
+		}
+}
 
-			case SDLK_1:
-				answer[0] = true;
-				break;
+void InputHandler::setPlayers(int count)
+{
+	// keys held now would stay down on bindings that no longer apply
+	releaseAll(SDL_GetTicks());
+	player_count = count;
+}
 
-			case SDLK_2:
-				answer[1] = true;
-				break;
+bool InputHandler::isQuit(bool clear)
+{
+	bool ret = quit;
+	if (clear) quit = false;
+	return ret;
+}
 
-			case SDLK_3:
-				answer[2] = true;
-				break;
-			}
+bool InputHandler::isHeld(ACTION action, int player)
+{
+	return (players[player].held >> action) & 1;
+}
 
-			break;
-		}
+bool InputHandler::isPressed(ACTION action, int player)
+{
+	return (players[player].pressed >> action) & 1;
+}
 
-		case SDL_KEYUP: {
-			switch (event.key.keysym.sym) {
-			case SDLK_ESCAPE:
-			case SDLK_p:
-				pause = false;
-				break;
+bool InputHandler::isReleased(ACTION action, int player)
+{
+	return (players[player].released >> action) & 1;
+}
 
-			case SDLK_UP:
-				player2[UP] = false;
-			case SDLK_w:
-				player[UP] = false;
-				break;
+bool InputHandler::consume(ACTION action, int player)
+{
+	uint32_t bit = uint32_t(1) << action;
+	bool ret = (players[player].held | players[player].latched) & bit;
 
-			case SDLK_RIGHT:
-				player2[RIGHT] = false;
-			case SDLK_d:
-				player[RIGHT] = false;
-				break;
+	players[player].latched &= ~bit;
 
-			case SDLK_DOWN:
-				player2[DOWN] = false;
-			case SDLK_s:
-				player[DOWN] = false;
-				break;
+	return ret;
+}
 
-			case SDLK_LEFT:
-				player2[LEFT] = false;
-			case SDLK_a:
-				player[LEFT] = false;
-				break;
+bool InputHandler::consumeClick(int *x, int *y)
+{
+	if (not click)
+		return false;
 
-			case SDLK_RETURN:
-				enter = false;
-				break;
+	*x = click_x;
+	*y = click_y;
+	click = false;
 
-			case SDLK_1:
-				answer[0] = false;
-				break;
+	return true;
+}
 
-			case SDLK_2:
-				answer[1] = false;
-				break;
+bool InputHandler::readEvent(uint64_t *cursor, INPUT_EVENT *event)
+{
+	if (*cursor + INPUT_QUEUE < queue_end)
+		*cursor = queue_end - INPUT_QUEUE;
 
-			case SDLK_3:
-				answer[2] = false;
-				break;
-			}
+	if (*cursor >= queue_end)
+		return false;
 
-			break;
-		}
-		}
+	*event = queue[(*cursor)++ % INPUT_QUEUE];
+
+	return true;
 }
 
-bool InputHandler::isQuit(bool clear)
+uint64_t InputHandler::getEventCount()
 {
-	bool ret = quit;
-	if (clear) quit = false;
-	return ret;
+	return queue_end;
 }
 
-bool InputHandler::isPlayer(DIR dir, bool clear)
+unsigned int InputHandler::getRenderResets()
 {
-	bool ret = player[dir];
-	if (clear) player[dir] = false;
-	return ret;
+	return render_resets;
 }
 
-bool InputHandler::isPlayer2(DIR dir, bool clear)
+void InputHandler::setBinding(size_t binding, bool down, uint32_t timestamp)
 {
-	bool ret = player2[dir];
-	if (clear) player2[dir] = false;
-	return ret;
+	uint64_t binding_bit = uint64_t(1) << binding;
+
+	if (down == bool(bindings_down & binding_bit))
+		return;
+
+	if (down)
+		bindings_down |= binding_bit;
+	else
+		bindings_down &= ~binding_bit;
+
+	const BINDING &it = BINDINGS[binding];
+	PLAYER &player = players[it.player];
+	uint32_t bit = uint32_t(1) << it.action;
+
+	queue[queue_end++ % INPUT_QUEUE] = {timestamp, it.key, it.player, it.action, down};
+
+	// the action stays held while any of its keys is
+	bool held = false;
+
+	for (size_t i = 0; i < BINDING_COUNT; ++i)
+		if (((bindings_down >> i) & 1) and BINDINGS[i].player == it.player and BINDINGS[i].action == it.action)
+			held = true;
+
+	if (held == bool(player.held & bit))
+		return;
+
+	if (held) {
+		player.held |= bit;
+		player.pressed |= bit;
+		player.latched |= bit;
+	} else {
+		player.held &= ~bit;
+		player.released |= bit;
+	}
 }
 
-bool InputHandler::isPause(bool clear)
+void InputHandler::releaseAll(uint32_t timestamp)
 {
-	bool ret = pause;
-	if (clear) pause = false;
-	return ret;
+	for (size_t i = 0; i < BINDING_COUNT; ++i)
+		if ((bindings_down >> i) & 1)
+			setBinding(i, false, timestamp);
 }
 
-bool InputHandler::isEnter(bool clear)
+InputRecorder::InputRecorder() :
+	cursor(0),
+	frame(0)
+{}
+
+InputRecorder::~InputRecorder()
 {
-	bool ret = enter;
-	if (clear) enter = false;
-	return ret;
+	if (file.is_open())
+		file << frame << " end\n";
 }
 
-bool InputHandler::isAnswer(int ans, bool clear)
+void InputRecorder::open(const std::filesystem::path &path, int map)
 {
-	if (ans < 1 or ans > 3)
-		return false;
+	file.open(path, std::ios::trunc);
 
-	bool ret = answer[ans - 1];
-	if (clear) answer[ans - 1] = false;
-	return ret;
+	if (not file)
+		throw std::runtime_error("cannot open " + path.string());
+
+	file << "# recorded, replay with OOQ_bench\n";
+
+	if (map >= 0)
+		file << "map " << map << '\n';
+}
+
+bool InputRecorder::isOpen()
+{
+	return file.is_open();
+}
+
+void InputRecorder::record(InputHandler *input, uint64_t time)
+{
+	if (not file.is_open())
+		return;
+
+	frame = time / REPLAY_FRAME_TIME;
+
+	INPUT_EVENT event;
+	INPUT_EVENT last = {};
+	bool first = true;
+
+	while (input->readEvent(&cursor, &event)) {
+		// one key bound twice queues twice, the script wants it once
+		if (not first and event.key == last.key and event.down == last.down and event.timestamp == last.timestamp)
+			continue;
+
+		file << frame << (event.down ? " down " : " up ") << SDL_GetKeyName(event.key) << '\n';
+
+		last = event;
+		first = false;
+	}
 }
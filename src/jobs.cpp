@@ -0,0 +1,190 @@
+#include "jobs.h"
+
+#include <algorithm>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+// queue of the running thread, 0 for any thread that is not a worker
+static thread_local size_t current_queue = 0;
+
+JobSystem::Group::Group() :
+	pending(0)
+{}
+
+bool JobSystem::Group::isDone()
+{
+	return pending == 0;
+}
+
+JobSystem::JobSystem(int workers) :
+	queued(0),
+	stop(false)
+{
+	if (workers < 0)
+		workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+	for (int i = 0; i <= workers; ++i)
+		queues.push_back(std::make_unique<QUEUE>());
+
+	for (int i = 1; i <= workers; ++i)
+		this->workers.emplace_back(&JobSystem::work, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stop = true;
+	}
+
+	wake.notify_all();
+
+	for (auto &worker : workers)
+		worker.join();
+}
+
+int JobSystem::getWorkerCount()
+{
+	return workers.size();
+}
+
+void JobSystem::submit(Group &group, std::function<void()> function)
+{
+	++group.pending;
+
+	QUEUE &queue = *queues[current_queue];
+
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back({std::move(function), &group});
+	}
+
+	{
+		// under the lock, a worker going to sleep sees it
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		++queued;
+	}
+
+	wake.notify_one();
+}
+
+void JobSystem::wait(Group &group)
+{
+	while (group.pending > 0)
+		if (not runOne(current_queue))
+			std::this_thread::yield();
+
+	std::exception_ptr error;
+
+	{
+		std::lock_guard<std::mutex> lock(error_mutex);
+		std::swap(error, group.error);
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &function)
+{
+	grain = std::max<size_t>(grain, 1);
+
+	if (count <= grain or workers.empty()) {
+		if (count)
+			function(0, count);
+
+		return;
+	}
+
+	Group group;
+
+	// the caller takes the first range itself
+	for (size_t begin = grain; begin < count; begin += grain) {
+		size_t end = std::min(begin + grain, count);
+		submit(group, [&function, begin, end]() { function(begin, end); });
+	}
+
+	std::exception_ptr error;
+
+	try {
+		function(0, grain);
+	} catch (...) {
+		error = std::current_exception();
+	}
+
+	// the ranges still point at function, always wait
+	wait(group);
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void JobSystem::work(size_t index)
+{
+	current_queue = index;
+
+	while (true) {
+		if (runOne(index))
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		wake.wait(lock, [this]() { return stop or queued > 0; });
+
+		if (stop)
+			return;
+	}
+}
+
+bool JobSystem::runOne(size_t index)
+{
+	JOB job;
+	bool found = false;
+
+	// own queue newest first, still warm in cache
+	{
+		QUEUE &queue = *queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (not queue.jobs.empty()) {
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			found = true;
+		}
+	}
+
+	// steal the oldest, likely the biggest piece left
+	for (size_t i = 1; not found and i < queues.size(); ++i) {
+		QUEUE &queue = *queues[(index + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (not queue.jobs.empty()) {
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			found = true;
+		}
+	}
+
+	if (not found)
+		return false;
+
+	--queued;
+	run(job);
+
+	return true;
+}
+
+void JobSystem::run(JOB &job)
+{
+	try {
+		job.function();
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(error_mutex);
+
+		if (not job.group->error)
+			job.group->error = std::current_exception();
+	}
+
+	--job.group->pending;
+}
@@ -0,0 +1,161 @@
+#include "lz.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+// shorter matches cost more than the literals they replace
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 12;
+
+static uint32_t read32(const char *data)
+{
+	uint32_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static size_t hash(uint32_t value)
+{
+	return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void writeLength(std::vector<char> &output, size_t length)
+{
+	while (length >= 255) {
+		output.push_back(static_cast<char>(255));
+		length -= 255;
+	}
+
+	output.push_back(static_cast<char>(length));
+}
+
+static void writeSequence(std::vector<char> &output, const char *literals, size_t literal_length, size_t offset, size_t match_length)
+{
+	size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+
+	uint8_t token = (literal_length < 15 ? literal_length : 15) << 4
+	                | (match_code < 15 ? match_code : 15);
+
+	output.push_back(static_cast<char>(token));
+
+	if (literal_length >= 15)
+		writeLength(output, literal_length - 15);
+
+	output.insert(output.end(), literals, literals + literal_length);
+
+	// the last sequence has literals only
+	if (not match_length)
+		return;
+
+	output.push_back(static_cast<char>(offset & 0xff));
+	output.push_back(static_cast<char>(offset >> 8));
+
+	if (match_code >= 15)
+		writeLength(output, match_code - 15);
+}
+
+std::vector<char> lzCompress(const char *data, size_t size)
+{
+	std::vector<char> output;
+	output.reserve(size / 2 + 16);
+
+	// last position seen for each hashed 4 bytes, +1 so 0 is empty
+	std::vector<size_t> table(size_t(1) << HASH_BITS, 0);
+
+	size_t anchor = 0;
+	size_t pos = 0;
+
+	while (size >= MIN_MATCH and pos + MIN_MATCH <= size) {
+		uint32_t value = read32(data + pos);
+		size_t &slot = table[hash(value)];
+		size_t candidate = slot;
+		slot = pos + 1;
+
+		if (not candidate or pos - (candidate - 1) > MAX_OFFSET or read32(data + candidate - 1) != value) {
+			++pos;
+			continue;
+		}
+
+		size_t match = candidate - 1;
+		size_t length = MIN_MATCH;
+
+		while (pos + length < size and data[match + length] == data[pos + length])
+			++length;
+
+		writeSequence(output, data + anchor, pos - anchor, pos - match, length);
+
+		pos += length;
+		anchor = pos;
+	}
+
+	writeSequence(output, data + anchor, size - anchor, 0, 0);
+
+	return output;
+}
+
+static bool readLength(const char *data, size_t size, size_t *pos, size_t *length)
+{
+	uint8_t byte;
+
+	do {
+		if (*pos >= size)
+			return false;
+
+		byte = data[(*pos)++];
+		*length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+bool lzDecompress(const char *data, size_t size, char *output, size_t output_size)
+{
+	size_t pos = 0;
+	size_t out = 0;
+
+	while (pos < size) {
+		uint8_t token = data[pos++];
+
+		size_t literal_length = token >> 4;
+		if (literal_length == 15 and not readLength(data, size, &pos, &literal_length))
+			return false;
+
+		if (literal_length > size - pos or literal_length > output_size - out)
+			return false;
+
+		std::memcpy(output + out, data + pos, literal_length);
+		pos += literal_length;
+		out += literal_length;
+
+		// literals only, must be the end
+		if (pos == size)
+			break;
+
+		if (size - pos < 2)
+			return false;
+
+		size_t offset = static_cast<uint8_t>(data[pos])
+		                | static_cast<uint8_t>(data[pos + 1]) << 8;
+		pos += 2;
+
+		size_t match_length = token & 15;
+		if (match_length == 15 and not readLength(data, size, &pos, &match_length))
+			return false;
+
+		match_length += MIN_MATCH;
+
+		if (offset == 0 or offset > out or match_length > output_size - out)
+			return false;
+
+		// byte by byte, matches may overlap what they produce
+		for (size_t i = 0; i < match_length; ++i, ++out)
+			output[out] = output[out - offset];
+	}
+
+	return out == output_size;
+}
@@ -1,4 +1,6 @@
 #include "manager.h"
+#include "config.h"
+#include "vfs.h"
 
 #include <cstdint>
 #include <stdexcept>
@@ -23,10 +25,69 @@
 Manager::Manager(int argc, char **argv) :
 	argc(argc),
 	argv(argv),
+	pipeline(false),
+	two_players(false),
+	watch(false),
+	last_watch(0),
+	text_created(0),
+	texture_evictions(0),
+	texture_restores(0),
 	last_tick(0),
 	current_tick(0),
-	is_quit(false)
+	is_quit(false),
+	tick_rate(TICK_RATE),
+	sim_ticks(0),
+	sim_time(0),
+	real_time(0)
 {
+	PACE_MODE mode = PACE_VSYNC;
+	int fps = 60;
+	bool software = false;
+	std::string archive = ARCHIVE_PATH;
+	std::string record;
+	int workers = -1;
+	size_t vram = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+
+		if (arg == "--vsync") {
+			mode = PACE_VSYNC;
+		} else if (arg == "--uncapped") {
+			mode = PACE_UNCAPPED;
+		} else if (arg == "--fps" and i + 1 < argc) {
+			mode = PACE_CAP;
+			fps = std::stoi(argv[++i]);
+		} else if (arg == "--tick-rate" and i + 1 < argc) {
+			tick_rate = std::stoi(argv[++i]);
+		} else if (arg == "--software") {
+			software = true;
+		} else if (arg == "--profile" and i + 1 < argc) {
+			profiler.openCsv(argv[++i]);
+		} else if (arg == "--archive" and i + 1 < argc) {
+			archive = argv[++i];
+		} else if (arg == "--record" and i + 1 < argc) {
+			record = argv[++i];
+		} else if (arg == "--jobs" and i + 1 < argc) {
+			workers = std::stoi(argv[++i]);
+		} else if (arg == "--pipeline") {
+			pipeline = true;
+		} else if (arg == "--two-players") {
+			two_players = true;
+		} else if (arg == "--watch") {
+			watch = true;
+		} else if (arg == "--vram" and i + 1 < argc) {
+			// MiB for textures, for machines that run out
+			vram = std::stoul(argv[++i]) * 1024 * 1024;
+		}
+	}
+
+	pacer = FramePacer(mode, fps);
+	jobs = std::make_unique<JobSystem>(workers);
+
+	if (tick_rate < 1 or tick_rate > 1000)
+		throw std::runtime_error("tick rate must be between 1 and 1000");
+
 	if (SDL_Init(SDL_INIT_VIDEO) != 0)
 		throw std::runtime_error(SDL_GetError());
 
@@ -36,10 +97,22 @@ Manager::Manager(int argc, char **argv) :
 	if (TTF_Init() != 0)
 		throw std::runtime_error(TTF_GetError());
 
-	renderer = new Renderer();
+	// loose files under data/ still win over what is packed
+	FileSystem::mount(archive);
+
+	// vsync would throttle the other modes twice
+	renderer = new Renderer(pacer.isVsync(), software);
+	renderer->getTextureManager()->setWatch(watch);
+	renderer->getTextureManager()->setBudget(vram);
 	input_handler = new InputHandler();
+	// the arrows move only the second player then
+	input_handler->setPlayers(two_players ? 2 : 1);
 	game_manager = new GameManager(this);
 	ui_manager = new UIManager(this);
+
+	// replayable with OOQ_bench
+	if (not record.empty())
+		recorder.open(record, game_manager->getMapManager()->getCurrentMap());
 }
 
 Manager::~Manager()
@@ -48,6 +121,7 @@ Manager::~Manager()
 	delete game_manager;
 	delete input_handler;
 	delete renderer;
+	FileSystem::unmount();
 	TTF_Quit();
 	IMG_Quit();
 	SDL_Quit();
@@ -78,42 +152,161 @@ void Manager::quit()
 	is_quit = true;
 }
 
-int Manager::operator()()
+int Manager::getTickRate()
 {
-	uint64_t delta = 0;
+	return tick_rate;
+}
 
-	while (not is_quit) {
-		/* 
-		 * switch to SDL_GetTicks64 after update to SDL 2.0.18
-		 * current_tick = SDL_GetTicks64();
-		 */
-		// get time passed since last frame
-		last_tick = current_tick;
-		current_tick = SDL_GetTicks();
-		delta = current_tick - last_tick;
+FramePacer *Manager::getPacer()
+{
+	return &pacer;
+}
 
-		// handle events
-		input_handler->processEvents();
-		if (input_handler->isQuit())
-			is_quit = true;
+JobSystem *Manager::getJobs()
+{
+	return jobs.get();
+}
 
-		game_manager->runTick(delta);
+Profiler *Manager::getProfiler()
+{
+	return &profiler;
+}
 
-		//ui_manager->runTick(delta);
-		(*ui_manager)(delta);
+void Manager::runFrame(uint64_t delta)
+{
+	// after a stall, drop time instead of catching up forever
+	static const uint64_t max_delta = 250000;
+	if (delta > max_delta)
+		delta = max_delta;
 
-		(*renderer)();
+	// handle events
+	profiler.begin(PHASE_EVENTS);
+	input_handler->processEvents();
+	profiler.end(PHASE_EVENTS);
+
+	if (input_handler->isQuit())
+		is_quit = true;
+
+	recorder.record(input_handler, real_time);
+
+	if (input_handler->isPressed(ACTION_DEBUG))
+		profiler.toggleOverlay();
+
+	// whole ms passed this frame, the rest carries over
+	uint64_t delta_ms = (real_time + delta) / 1000 - real_time / 1000;
+	real_time += delta;
+
+	// a background map load finishing swaps in here, between frames
+	game_manager->getMapManager()->update();
+
+	// edits to images first, chunks using them are drawn again
+	if (watch and real_time - last_watch >= WATCH_INTERVAL * 1000) {
+		last_watch = real_time;
+
+		std::vector<std::filesystem::path> changed = renderer->getTextureManager()->reloadChanged();
+		game_manager->getMapManager()->hotReload(changed);
+	}
+
+	// step the simulation for all the time owed
+	uint64_t next_time = (sim_ticks + 1) * 1000 / tick_rate;
+
+	while (next_time * 1000 <= real_time) {
+		// steps differ by at most 1 ms when 1000 % tick_rate != 0
+		game_manager->runTick(next_time - sim_time);
+
+		sim_time = next_time;
+		next_time = (++sim_ticks + 1) * 1000 / tick_rate;
+	}
+
+	// how far the frame is between the last step and the next
+	double alpha = double(real_time - sim_time * 1000)
+	               / ((next_time - sim_time) * 1000);
+
+	if (pipeline) {
+		game_manager->beginRender(alpha);
+
+		// the last frame goes out while the jobs build this one
+		profiler.begin(PHASE_RENDER);
+		renderer->present();
+		profiler.end(PHASE_RENDER);
+
+		game_manager->endRender();
+
+		// only now is the last frame done with what it released
+		profiler.begin(PHASE_CLEANUP);
 		renderer->getTextureManager()->cleanup();
+		profiler.end(PHASE_CLEANUP);
+	} else {
+		game_manager->render(alpha);
+	}
+
+	//ui_manager->runTick(delta);
+	profiler.begin(PHASE_UI);
+	(*ui_manager)(delta_ms);
+	profiler.end(PHASE_UI);
+
+	profiler.render(renderer);
+
+	profiler.begin(PHASE_RENDER);
+	if (pipeline)
+		renderer->submit();
+	else
+		(*renderer)();
+	profiler.end(PHASE_RENDER);
+
+	TextureManager *texture_manager = renderer->getTextureManager();
+
+	// the submitted frame still draws next frame when pipelining
+	if (not pipeline) {
+		profiler.begin(PHASE_CLEANUP);
+		texture_manager->cleanup();
+		profiler.end(PHASE_CLEANUP);
+	}
+
+	int items, draws;
+	renderer->getStats(&items, &draws);
 
-		// limit fps
-		static const uint64_t max_fps = 60;
-		static const uint64_t min_ticks = 1000 / max_fps;
+	profiler.setCounter(COUNTER_ITEMS, items);
+	profiler.setCounter(COUNTER_DRAWS, draws);
+	profiler.setCounter(COUNTER_TEXTURES, texture_manager->getTextureCount());
+	profiler.setCounter(COUNTER_TEXT, texture_manager->getTextCreated() - text_created);
+	text_created = texture_manager->getTextCreated();
+	profiler.setCounter(COUNTER_CHUNKS, game_manager->getMapManager()->getResidentChunks());
+
+	size_t resident, bytes;
+	unsigned long hits, misses, evictions;
+	texture_manager->getMemoryStats(&resident, &bytes, &hits, &misses, &evictions);
+
+	profiler.setCounter(COUNTER_TEXTURE_KB, bytes / 1024);
+	profiler.setCounter(COUNTER_EVICTIONS, evictions - texture_evictions);
+	profiler.setCounter(COUNTER_RESTORES, misses - texture_restores);
+	texture_evictions = evictions;
+	texture_restores = misses;
+
+	profiler.endFrame();
+}
+
+bool Manager::isQuit()
+{
+	return is_quit;
+}
+
+bool Manager::isTwoPlayers()
+{
+	return two_players;
+}
+
+int Manager::operator()()
+{
+	while (not is_quit) {
+		// get time passed since last frame, in us
+		last_tick = current_tick;
+		current_tick = pacer.getMicros();
 
-		// calculate time it took to run this frame
-		delta = SDL_GetTicks() - current_tick;
+		runFrame(current_tick - last_tick);
 
-		if (delta < min_ticks)
-			SDL_Delay(min_ticks - delta);
+		// vsync already waited in present
+		pacer.wait();
 	}
 
 	return 0;
@@ -0,0 +1,322 @@
+#include "mapfile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+static const char MAGIC[4] = {'O', 'O', 'Q', 'M'};
+
+static void append(std::vector<char> &buffer, const void *data, size_t size)
+{
+	const char *bytes = static_cast<const char *>(data);
+	buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+static void appendString(std::vector<char> &buffer, const std::string &text)
+{
+	if (text.size() > UINT16_MAX)
+		throw std::runtime_error("path too long: " + text);
+
+	uint16_t length = text.size();
+	append(buffer, &length, sizeof(length));
+	append(buffer, text.data(), text.size());
+}
+
+static void align(std::vector<char> &buffer)
+{
+	// grid and collision are read in place, keep them word aligned
+	buffer.resize((buffer.size() + 7) / 8 * 8, 0);
+}
+
+static std::string_view readString(const char *data, size_t size, size_t *offset)
+{
+	uint16_t length;
+
+	if (*offset + sizeof(length) > size)
+		throw std::runtime_error("map file truncated");
+
+	std::memcpy(&length, data + *offset, sizeof(length));
+	*offset += sizeof(length);
+
+	if (*offset + length > size)
+		throw std::runtime_error("map file truncated");
+
+	std::string_view text(data + *offset, length);
+	*offset += length;
+
+	return text;
+}
+
+MapFile::MapFile(const std::filesystem::path &path) :
+	file(FileSystem::open(path))
+{
+	data = file.getData();
+	parse(file.getSize());
+}
+
+MapFile::MapFile(const MapData &map) :
+	buffer(compileMap(map))
+{
+	data = buffer.data();
+	parse(buffer.size());
+}
+
+void MapFile::getSpawn(int *x, int *y)
+{
+	*x = header->spawn_x;
+	*y = header->spawn_y;
+}
+
+void MapFile::getSize(int *x, int *y)
+{
+	*x = header->width;
+	*y = header->height;
+}
+
+const std::vector<std::string_view> &MapFile::getTiles()
+{
+	return tiles;
+}
+
+const uint16_t *MapFile::getRow(int layer, int y)
+{
+	return grid + (static_cast<size_t>(layer) * header->height + y) * header->width;
+}
+
+const uint64_t *MapFile::getCollisionRow(int y)
+{
+	return collision + y * stride;
+}
+
+bool MapFile::getCollision(int x, int y)
+{
+	if (x < 0 or y < 0 or
+	    x >= static_cast<int>(header->width) or
+	    y >= static_cast<int>(header->height))
+		return true; // default collision for OOB
+
+	return (collision[y * stride + x / 64] >> (x % 64)) & 1;
+}
+
+const std::vector<MapFile::OBJECT> &MapFile::getObjects()
+{
+	return objects;
+}
+
+void MapFile::parse(size_t size)
+{
+	if (not data or size < sizeof(MapHeader))
+		throw std::runtime_error("map file truncated");
+
+	header = reinterpret_cast<const MapHeader *>(data);
+
+	if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+		throw std::runtime_error("not a compiled map");
+
+	if (header->version != MAP_VERSION or header->layers != MAP_LAYERS)
+		throw std::runtime_error("unsupported map version, rerun ooq-mapc");
+
+	if (header->size != size)
+		throw std::runtime_error("map file truncated");
+
+	stride = (header->width + 63) / 64;
+
+	uint64_t cells = static_cast<uint64_t>(header->width) * header->height;
+	uint64_t grid_end = header->grid_offset + cells * MAP_LAYERS * sizeof(uint16_t);
+	uint64_t collision_end = header->collision_offset
+	                         + stride * header->height * sizeof(uint64_t);
+
+	if (grid_end > size or collision_end > size or
+	    header->grid_offset % 8 or header->collision_offset % 8)
+		throw std::runtime_error("map file corrupted");
+
+	grid = reinterpret_cast<const uint16_t *>(data + header->grid_offset);
+	collision = reinterpret_cast<const uint64_t *>(data + header->collision_offset);
+
+	size_t offset = header->tile_offset;
+	tiles.reserve(header->tile_count);
+
+	for (uint32_t i = 0; i < header->tile_count; ++i)
+		tiles.push_back(readString(data, size, &offset));
+
+	offset = header->object_offset;
+	objects.reserve(header->object_count);
+
+	for (uint32_t i = 0; i < header->object_count; ++i) {
+		int32_t pos[2];
+
+		if (offset + sizeof(pos) > size)
+			throw std::runtime_error("map file truncated");
+
+		std::memcpy(pos, data + offset, sizeof(pos));
+		offset += sizeof(pos);
+
+		objects.push_back({pos[0], pos[1], readString(data, size, &offset)});
+	}
+}
+
+std::vector<std::filesystem::path> readMapList(const std::filesystem::path &path)
+{
+	std::vector<std::filesystem::path> maps;
+
+	if (not FileSystem::exists(path))
+		return maps;
+
+	std::istringstream maps_file(FileSystem::read(path));
+
+	int id;
+	std::filesystem::path map;
+
+	while (maps_file >> id >> map) {
+		if (id < 0)
+			throw std::runtime_error("negative map id in " + path.string());
+
+		if (static_cast<size_t>(id) >= maps.size())
+			maps.resize(id + 1);
+
+		maps[id] = map;
+	}
+
+	return maps;
+}
+
+MapData readMapText(const std::filesystem::path &path)
+{
+	// throws if missing
+	std::istringstream data(FileSystem::read(path));
+
+	MapData map;
+
+	// read default spawn coords
+	data >> map.spawn_x >> map.spawn_y;
+
+	struct TILE {
+		int pos_x, pos_y;
+		uint16_t id;
+		bool coll;
+		int layer;
+	};
+
+	std::vector<TILE> cells;
+	std::unordered_map<std::filesystem::path::string_type, uint16_t> unique;
+
+	int pos_x, pos_y;
+	std::filesystem::path tile_path;
+
+	while (data >> pos_x >> pos_y >> tile_path) {
+		if (pos_x < 0 or pos_y < 0)
+			throw std::runtime_error("negative position in " + path.string());
+
+		// map is as big as the furthest tile or object
+		map.width = std::max(map.width, pos_x + 1);
+		map.height = std::max(map.height, pos_y + 1);
+
+		if (tile_path.extension() == ".png") {
+			bool coll;
+			int layer;
+
+			// stop at malformed lines, like the game always did
+			if (not (data >> coll >> layer))
+				break;
+
+			if (layer < 0 or layer >= MAP_LAYERS)
+				throw std::runtime_error("bad layer in " + path.string());
+
+			auto found = unique.find(tile_path.native());
+
+			if (found == unique.end()) {
+				if (map.tiles.size() >= UINT16_MAX)
+					throw std::runtime_error("too many tiles in " + path.string());
+
+				map.tiles.push_back(tile_path);
+				found = unique.emplace(tile_path.native(), map.tiles.size()).first;
+			}
+
+			cells.push_back({pos_x, pos_y, found->second, coll, layer});
+		} else if (tile_path.extension() == ".txt") {
+			map.objects.push_back({pos_x, pos_y, tile_path});
+		}
+	}
+
+	size_t size = static_cast<size_t>(map.width) * map.height;
+
+	map.grid.assign(MAP_LAYERS * size, 0);
+	// cells without tiles block movement
+	map.collision.assign(size, true);
+
+	// later lines win, same as loading the text directly
+	for (auto &it : cells) {
+		map.grid[it.layer * size + it.pos_y * map.width + it.pos_x] = it.id;
+		map.collision[it.pos_y * map.width + it.pos_x] = it.coll;
+	}
+
+	return map;
+}
+
+std::vector<char> compileMap(const MapData &map)
+{
+	std::vector<char> buffer(sizeof(MapHeader), 0);
+	MapHeader header;
+
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = MAP_VERSION;
+	header.spawn_x = map.spawn_x;
+	header.spawn_y = map.spawn_y;
+	header.width = map.width;
+	header.height = map.height;
+	header.layers = MAP_LAYERS;
+	header.tile_count = map.tiles.size();
+	header.object_count = map.objects.size();
+
+	header.tile_offset = buffer.size();
+	for (auto &it : map.tiles)
+		appendString(buffer, it.generic_string());
+
+	align(buffer);
+	header.grid_offset = buffer.size();
+	append(buffer, map.grid.data(), map.grid.size() * sizeof(uint16_t));
+
+	align(buffer);
+	header.collision_offset = buffer.size();
+
+	size_t stride = (map.width + 63) / 64;
+	std::vector<uint64_t> row(stride);
+
+	for (int y = 0; y < map.height; ++y) {
+		std::fill(row.begin(), row.end(), 0);
+
+		for (int x = 0; x < map.width; ++x)
+			if (map.collision[y * map.width + x])
+				row[x / 64] |= uint64_t(1) << (x % 64);
+
+		append(buffer, row.data(), row.size() * sizeof(uint64_t));
+	}
+
+	header.object_offset = buffer.size();
+	for (auto &it : map.objects) {
+		int32_t pos[2] = {it.pos_x, it.pos_y};
+		append(buffer, pos, sizeof(pos));
+		appendString(buffer, it.path.generic_string());
+	}
+
+	header.size = buffer.size();
+	std::memcpy(buffer.data(), &header, sizeof(header));
+
+	return buffer;
+}
+
+void writeMapFile(const std::filesystem::path &path, const MapData &map)
+{
+	std::vector<char> buffer = compileMap(map);
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+	if (not file.write(buffer.data(), buffer.size()))
+		throw std::runtime_error("cannot write " + path.string());
+}
@@ -0,0 +1,128 @@
+#include "mappedfile.h"
+
+#include <stdexcept>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <ciso646>
+#else
+#error Unsupported platform
+#endif
+
+#ifdef __unix__
+MappedFile::MappedFile(const std::filesystem::path &path) :
+	data(nullptr),
+	size(0)
+{
+	file = open(path.c_str(), O_RDONLY);
+
+	if (file < 0)
+		throw std::runtime_error("cannot open " + path.string());
+
+	struct stat info;
+
+	if (fstat(file, &info) != 0) {
+		close(file);
+		throw std::runtime_error("cannot stat " + path.string());
+	}
+
+	size = info.st_size;
+
+	// mapping nothing is an error, leave data empty instead
+	if (size == 0)
+		return;
+
+	void *view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+
+	if (view == MAP_FAILED) {
+		close(file);
+		throw std::runtime_error("cannot map " + path.string());
+	}
+
+	data = static_cast<const char *>(view);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+		munmap(const_cast<char *>(data), size);
+
+	close(file);
+}
+#elif _WIN32
+MappedFile::MappedFile(const std::filesystem::path &path) :
+	data(nullptr),
+	size(0),
+	mapping(nullptr)
+{
+	file = CreateFileW(
+		path.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		nullptr
+	);
+
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("cannot open " + path.string());
+
+	LARGE_INTEGER file_size;
+
+	if (not GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("cannot stat " + path.string());
+	}
+
+	size = file_size.QuadPart;
+
+	// mapping nothing is an error, leave data empty instead
+	if (size == 0)
+		return;
+
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (not mapping) {
+		CloseHandle(file);
+		throw std::runtime_error("cannot map " + path.string());
+	}
+
+	data = static_cast<const char *>(
+		MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)
+	);
+
+	if (not data) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("cannot map " + path.string());
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+		UnmapViewOfFile(data);
+
+	if (mapping)
+		CloseHandle(mapping);
+
+	CloseHandle(file);
+}
+#endif
+
+const char *MappedFile::getData()
+{
+	return data;
+}
+
+size_t MappedFile::getSize()
+{
+	return size;
+}
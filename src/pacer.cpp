@@ -0,0 +1,90 @@
+#include "pacer.h"
+
+#include <stdexcept>
+
+#ifdef __unix__
+#include <SDL2/SDL.h>
+#elif _WIN32
+#include <ciso646>
+#include <SDL.h>
+#else
+#error Unsupported platform
+#endif
+
+FramePacer::FramePacer(PACE_MODE mode, int fps) :
+	mode(mode),
+	fps(fps)
+{
+	if (mode == PACE_CAP and fps < 1)
+		throw std::runtime_error("fps cap must be positive");
+
+	frequency = SDL_GetPerformanceFrequency();
+	start = SDL_GetPerformanceCounter();
+	deadline = start;
+}
+
+PACE_MODE FramePacer::getMode()
+{
+	return mode;
+}
+
+int FramePacer::getFps()
+{
+	return fps;
+}
+
+bool FramePacer::isVsync()
+{
+	return mode == PACE_VSYNC;
+}
+
+uint64_t FramePacer::getTicks()
+{
+	uint64_t elapsed = SDL_GetPerformanceCounter() - start;
+
+	// split to avoid overflow on fast counters
+	return elapsed / frequency * 1000 + elapsed % frequency * 1000 / frequency;
+}
+
+uint64_t FramePacer::getMicros()
+{
+	uint64_t elapsed = SDL_GetPerformanceCounter() - start;
+
+	return elapsed / frequency * 1000000 + elapsed % frequency * 1000000 / frequency;
+}
+
+void FramePacer::wait()
+{
+	if (mode != PACE_CAP)
+		return;
+
+	// sleep is only trusted up to this close to the deadline
+	static const uint64_t SPIN_MS = 2;
+
+	uint64_t period = frequency / fps;
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	deadline += period;
+
+	if (now >= deadline) {
+		// more than a frame late, start over instead of rushing to catch up
+		if (now - deadline > period)
+			deadline = now;
+
+		return;
+	}
+
+	uint64_t spin = frequency * SPIN_MS / 1000;
+
+	while (now < deadline and deadline - now > spin) {
+		uint32_t ms = (deadline - now - spin) * 1000 / frequency;
+
+		if (ms == 0)
+			break;
+
+		SDL_Delay(ms);
+		now = SDL_GetPerformanceCounter();
+	}
+
+	while (SDL_GetPerformanceCounter() < deadline) {}
+}
@@ -0,0 +1,324 @@
+#include "path.h"
+
+#include "game.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+PathFinder::PathFinder(GameManager *parent) :
+	parent(parent),
+	stale(true),
+	visit(0),
+	use_count(0),
+	searches(0),
+	cache_hits(0)
+{}
+
+void PathFinder::reset()
+{
+	stale = true;
+}
+
+void PathFinder::invalidate(int x, int y, int size_x, int size_y)
+{
+	// nothing to patch until the first rebuild
+	if (not stale)
+		dirty.push_back({x, y, size_x, size_y});
+}
+
+bool PathFinder::findPath(int start_x, int start_y, int goal_x, int goal_y, int size_x, int size_y, std::vector<WAYPOINT> *path)
+{
+	sync();
+	path->clear();
+
+	if (findCached(start_x, start_y, goal_x, goal_y, size_x, size_y, path))
+		return true;
+
+	++searches;
+
+	if (not search(start_x, start_y, goal_x, goal_y, size_x, size_y, path))
+		return false;
+
+	store(goal_x, goal_y, size_x, size_y, *path);
+
+	return true;
+}
+
+void PathFinder::request(ObjectWalker *walker, int goal_x, int goal_y)
+{
+	for (auto &it : queries)
+		if (it.walker == walker) {
+			it.goal_x = goal_x;
+			it.goal_y = goal_y;
+			return;
+		}
+
+	queries.push_back({walker, goal_x, goal_y});
+}
+
+void PathFinder::cancel(ObjectWalker *walker)
+{
+	std::erase_if(queries, [walker](const QUERY &it) {
+		return it.walker == walker;
+	});
+}
+
+void PathFinder::runBatch()
+{
+	if (queries.empty())
+		return;
+
+	size_t count = std::min(queries.size(), size_t(PATH_BUDGET));
+
+	// same goals next to each other, later ones may start on an earlier path
+	std::stable_sort(queries.begin(), queries.begin() + count, [](const QUERY &a, const QUERY &b) {
+		return a.goal_y != b.goal_y ? a.goal_y < b.goal_y : a.goal_x < b.goal_x;
+	});
+
+	std::vector<WAYPOINT> path;
+
+	for (size_t i = 0; i < count; ++i) {
+		QUERY &query = queries[i];
+		GameObject *object = query.walker->getParent();
+
+		int map_x, map_y, size_x, size_y;
+		object->getMapPos(&map_x, &map_y);
+		object->getSize(&size_x, &size_y);
+
+		if (findPath(map_x, map_y, query.goal_x, query.goal_y, size_x, size_y, &path))
+			// the walker stands on the first one already
+			query.walker->setPath(std::vector<WAYPOINT>(path.begin() + 1, path.end()));
+		else
+			query.walker->clearPath();
+	}
+
+	queries.erase(queries.begin(), queries.begin() + count);
+}
+
+void PathFinder::getStats(unsigned long *searches, unsigned long *cache_hits)
+{
+	*searches = this->searches;
+	*cache_hits = this->cache_hits;
+}
+
+void PathFinder::sync()
+{
+	int size_x, size_y;
+	parent->getMapManager()->getSize(&size_x, &size_y);
+
+	if (stale or nav.getWidth() != size_x or nav.getHeight() != size_y) {
+		nav.resize(size_x, size_y);
+
+		for (int j = 0; j < size_y; ++j)
+			for (int i = 0; i < size_x; ++i)
+				nav.set(i, j, isBlocked(i, j));
+
+		cache.clear();
+		dirty.clear();
+		stale = false;
+
+		return;
+	}
+
+	if (dirty.empty())
+		return;
+
+	std::vector<uint32_t> touched;
+
+	for (auto &it : dirty) {
+		int begin_x = std::max(it.x, 0);
+		int begin_y = std::max(it.y, 0);
+		int end_x = std::min(it.x + it.w, size_x);
+		int end_y = std::min(it.y + it.h, size_y);
+
+		if (begin_x >= end_x or begin_y >= end_y)
+			continue;
+
+		for (int j = begin_y; j < end_y; ++j)
+			for (int i = begin_x; i < end_x; ++i)
+				nav.set(i, j, isBlocked(i, j));
+
+		for (int j = begin_y / PATH_REGION; j <= (end_y - 1) / PATH_REGION; ++j)
+			for (int i = begin_x / PATH_REGION; i <= (end_x - 1) / PATH_REGION; ++i)
+				touched.push_back(getRegion(i * PATH_REGION, j * PATH_REGION));
+	}
+
+	dirty.clear();
+
+	std::sort(touched.begin(), touched.end());
+	touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+	// paths elsewhere stay valid, blocked and freed cells alike
+	std::erase_if(cache, [&touched](const ENTRY &entry) {
+		std::vector<uint32_t>::const_iterator a = entry.regions.begin();
+		std::vector<uint32_t>::const_iterator b = touched.begin();
+
+		while (a != entry.regions.end() and b != touched.end()) {
+			if (*a == *b)
+				return true;
+
+			if (*a < *b)
+				++a;
+			else
+				++b;
+		}
+
+		return false;
+	});
+}
+
+bool PathFinder::isBlocked(int x, int y)
+{
+	if (parent->getMapManager()->getCollision(x, y))
+		return true;
+
+	GameObject *object = parent->getCollision(x, y);
+
+	return object and object->isObstacle();
+}
+
+bool PathFinder::findCached(int start_x, int start_y, int goal_x, int goal_y, int size_x, int size_y, std::vector<WAYPOINT> *path)
+{
+	for (auto &entry : cache) {
+		if (entry.goal_x != goal_x or entry.goal_y != goal_y or
+		    entry.size_x != size_x or entry.size_y != size_y)
+			continue;
+
+		// the rest of a path is the best path from there too
+		for (size_t i = 0; i < entry.path.size(); ++i)
+			if (entry.path[i].x == start_x and entry.path[i].y == start_y) {
+				path->assign(entry.path.begin() + i, entry.path.end());
+				entry.used = ++use_count;
+				++cache_hits;
+
+				return true;
+			}
+	}
+
+	return false;
+}
+
+bool PathFinder::search(int start_x, int start_y, int goal_x, int goal_y, int size_x, int size_y, std::vector<WAYPOINT> *path)
+{
+	int width = nav.getWidth();
+	int height = nav.getHeight();
+
+	if (start_x < 0 or start_y < 0 or start_x >= width or start_y >= height)
+		return false;
+
+	// the start may overlap something, it is left anyway
+	if (nav.any(goal_x, goal_y, size_x, size_y))
+		return false;
+
+	size_t cells = static_cast<size_t>(width) * height;
+	if (nodes.size() < cells)
+		nodes.resize(cells, NODE{0, 0, -1});
+
+	// stamps instead of clearing, wraps after 4 billion searches
+	if (++visit == 0) {
+		for (auto &it : nodes)
+			it.visit = 0;
+
+		visit = 1;
+	}
+
+	auto estimate = [&](int x, int y) {
+		return static_cast<uint32_t>(std::abs(goal_x - x) + std::abs(goal_y - y));
+	};
+
+	// lowest estimate first, ties go to the one further along
+	auto later = [](const OPEN &a, const OPEN &b) {
+		return a.estimate != b.estimate ? a.estimate > b.estimate : a.cost < b.cost;
+	};
+
+	static const int STEP_X[4] = {0, 1, 0, -1};
+	static const int STEP_Y[4] = {-1, 0, 1, 0};
+
+	int32_t start = start_y * width + start_x;
+	int32_t goal = goal_y * width + goal_x;
+
+	nodes[start] = {visit, 0, -1};
+
+	open.clear();
+	open.push_back({estimate(start_x, start_y), 0, start});
+
+	int expanded = 0;
+
+	while (not open.empty()) {
+		std::pop_heap(open.begin(), open.end(), later);
+		OPEN current = open.back();
+		open.pop_back();
+
+		// reached cheaper since it was queued
+		if (current.cost > nodes[current.cell].cost)
+			continue;
+
+		if (current.cell == goal) {
+			for (int32_t cell = goal; cell != -1; cell = nodes[cell].from)
+				path->push_back({cell % width, cell / width});
+
+			std::reverse(path->begin(), path->end());
+
+			return true;
+		}
+
+		if (++expanded > PATH_MAX_NODES)
+			break;
+
+		int x = current.cell % width;
+		int y = current.cell / width;
+
+		for (int i = 0; i < 4; ++i) {
+			int next_x = x + STEP_X[i];
+			int next_y = y + STEP_Y[i];
+
+			if (nav.any(next_x, next_y, size_x, size_y))
+				continue;
+
+			int32_t cell = next_y * width + next_x;
+			uint32_t cost = current.cost + 1;
+			NODE &next = nodes[cell];
+
+			if (next.visit == visit and next.cost <= cost)
+				continue;
+
+			next = {visit, cost, current.cell};
+
+			open.push_back({cost + estimate(next_x, next_y), cost, cell});
+			std::push_heap(open.begin(), open.end(), later);
+		}
+	}
+
+	return false;
+}
+
+void PathFinder::store(int goal_x, int goal_y, int size_x, int size_y, const std::vector<WAYPOINT> &path)
+{
+	if (cache.size() >= PATH_CACHE)
+		cache.erase(std::min_element(cache.begin(), cache.end(), [](const ENTRY &a, const ENTRY &b) {
+			return a.used < b.used;
+		}));
+
+	ENTRY entry = {goal_x, goal_y, size_x, size_y, path, {}, ++use_count};
+
+	for (auto &it : path)
+		for (int j = it.y / PATH_REGION; j <= (it.y + size_y - 1) / PATH_REGION; ++j)
+			for (int i = it.x / PATH_REGION; i <= (it.x + size_x - 1) / PATH_REGION; ++i)
+				entry.regions.push_back(getRegion(i * PATH_REGION, j * PATH_REGION));
+
+	std::sort(entry.regions.begin(), entry.regions.end());
+	entry.regions.erase(std::unique(entry.regions.begin(), entry.regions.end()), entry.regions.end());
+
+	cache.push_back(std::move(entry));
+}
+
+uint32_t PathFinder::getRegion(int x, int y)
+{
+	uint32_t regions_x = (nav.getWidth() + PATH_REGION - 1) / PATH_REGION;
+
+	return (y / PATH_REGION) * regions_x + x / PATH_REGION;
+}
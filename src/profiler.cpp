@@ -0,0 +1,197 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __unix__
+#include <SDL2/SDL.h>
+#elif _WIN32
+#include <ciso646>
+#include <SDL.h>
+#else
+#error Unsupported platform
+#endif
+
+Profiler::Profiler() :
+	frame_count(0),
+	started{},
+	elapsed{},
+	counters{},
+	overlay_elapsed{},
+	overlay_total(0),
+	overlay_counters{},
+	overlay_frames(0),
+	overlay(false)
+{
+	frequency = SDL_GetPerformanceFrequency();
+	frame_start = SDL_GetPerformanceCounter();
+	overlay_update = frame_start;
+}
+
+void Profiler::openCsv(const std::filesystem::path &path)
+{
+	csv.open(path, std::ios::trunc);
+
+	if (not csv)
+		throw std::runtime_error("cannot write " + path.string());
+
+	csv << "frame,frame_us";
+
+	for (int i = 0; i < PHASE_SIZE; ++i)
+		csv << ',' << getName(static_cast<PHASE>(i)) << "_us";
+
+	for (int i = 0; i < COUNTER_SIZE; ++i)
+		csv << ',' << getName(static_cast<COUNTER>(i));
+
+	csv << '\n';
+}
+
+void Profiler::begin(PHASE phase)
+{
+	started[phase] = SDL_GetPerformanceCounter();
+}
+
+void Profiler::end(PHASE phase)
+{
+	elapsed[phase] += SDL_GetPerformanceCounter() - started[phase];
+}
+
+void Profiler::setCounter(COUNTER counter, long value)
+{
+	counters[counter] = value;
+}
+
+void Profiler::toggleOverlay()
+{
+	overlay = not overlay;
+}
+
+bool Profiler::isOverlay()
+{
+	return overlay;
+}
+
+void Profiler::endFrame()
+{
+	uint64_t now = SDL_GetPerformanceCounter();
+	uint64_t total = now - frame_start;
+
+	if (csv.is_open()) {
+		csv << frame_count << ',' << std::llround(micros(total));
+
+		for (auto it : elapsed)
+			csv << ',' << std::llround(micros(it));
+
+		for (auto it : counters)
+			csv << ',' << it;
+
+		csv << '\n';
+	}
+
+	for (int i = 0; i < PHASE_SIZE; ++i)
+		overlay_elapsed[i] += elapsed[i];
+
+	for (int i = 0; i < COUNTER_SIZE; ++i)
+		overlay_counters[i] += counters[i];
+
+	overlay_total += total;
+	++overlay_frames;
+
+	// rebuild the text twice a second, new strings cost new textures
+	if (now - overlay_update >= frequency / 2) {
+		std::ostringstream buf;
+		buf << std::fixed << std::setprecision(2);
+
+		lines.clear();
+
+		buf << "frame " << micros(overlay_total) / overlay_frames / 1000 << " ms";
+		lines.push_back(buf.str());
+
+		for (int i = 0; i < PHASE_SIZE; ++i) {
+			buf.str("");
+			buf << getName(static_cast<PHASE>(i)) << ' '
+			    << micros(overlay_elapsed[i]) / overlay_frames / 1000 << " ms";
+			lines.push_back(buf.str());
+		}
+
+		for (int i = 0; i < COUNTER_SIZE; ++i) {
+			buf.str("");
+			buf << getName(static_cast<COUNTER>(i)) << ' '
+			    << overlay_counters[i] / overlay_frames;
+			lines.push_back(buf.str());
+		}
+
+		std::fill(std::begin(overlay_elapsed), std::end(overlay_elapsed), 0);
+		std::fill(std::begin(overlay_counters), std::end(overlay_counters), 0);
+		overlay_total = 0;
+		overlay_frames = 0;
+		overlay_update = now;
+	}
+
+	std::fill(std::begin(elapsed), std::end(elapsed), 0);
+	std::fill(std::begin(counters), std::end(counters), 0);
+
+	frame_start = now;
+	++frame_count;
+}
+
+void Profiler::render(Renderer *renderer)
+{
+	if (not overlay)
+		return;
+
+	// above every ui layer
+	static const int LAYER = 1000;
+	static const int SPACING = 12;
+
+	TextureManager *texture_manager = renderer->getTextureManager();
+	int y = 2;
+
+	for (auto &it : lines) {
+		renderer->addRenderItem(texture_manager->makeText(it, WHITE), 2, y, false, false, LAYER, true);
+		y += SPACING;
+	}
+}
+
+const char *Profiler::getName(PHASE phase)
+{
+	static const char *NAMES[PHASE_SIZE] = {
+		"events",
+		"collision",
+		"path",
+		"objects",
+		"quiz",
+		"map",
+		"draw",
+		"ui",
+		"render",
+		"cleanup"
+	};
+
+	return NAMES[phase];
+}
+
+const char *Profiler::getName(COUNTER counter)
+{
+	static const char *NAMES[COUNTER_SIZE] = {
+		"items",
+		"draw_calls",
+		"textures",
+		"text_created",
+		"chunks_resident",
+		"texture_kb",
+		"evictions",
+		"restores"
+	};
+
+	return NAMES[counter];
+}
+
+double Profiler::micros(uint64_t counts)
+{
+	return counts * 1000000.0 / frequency;
+}
@@ -1,10 +1,22 @@
 #include "render.h"
 
 #include "config.h"
+#include "vfs.h"
 
+#include <cmath>
+#include <cstring>
 #include <stdexcept>
 #include <compare>
 #include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <utility>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 
 #ifdef __unix__
 #include <SDL2/SDL_image.h>
@@ -15,238 +27,1320 @@
 #error Unsupported platform
 #endif
 
-Texture::Texture(Renderer *renderer, std::filesystem::path path, bool keep) :
-	path(path),
-	usage(0),
-	keep(keep)
+// index entry of a path whose texture is not loaded
+static const uint32_t NO_SLOT = UINT32_MAX;
+
+AtlasPage::AtlasPage(Renderer *renderer, int size) :
+	size(size),
+	shelf_x(0),
+	shelf_y(0),
+	shelf_height(0),
+	regions(0)
 {
-	SDL_Surface *surface;
-	if (!path.empty() and std::filesystem::exists(path)) {
-		surface = IMG_Load(path.string().c_str());
+	texture = SDL_CreateTexture(
+			renderer->getRenderer(),
+			renderer->getFormat()->format,
+			SDL_TEXTUREACCESS_STATIC,
+			size, size
+		);
 
-		if (!surface)
-			throw std::runtime_error(IMG_GetError());
+	if (!texture)
+		throw std::runtime_error(SDL_GetError());
+
+	SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+}
+
+AtlasPage::~AtlasPage()
+{
+	SDL_DestroyTexture(texture);
+}
+
+bool AtlasPage::insert(SDL_Surface *surface, SDL_Rect *region)
+{
+	// empty pixel between regions to keep filtering from bleeding
+	static const int PADDING = 1;
+
+	int x = shelf_x;
+	int y = shelf_y;
+	int height = shelf_height;
+
+	// start new shelf if this one is full
+	if (x + surface->w > size) {
+		x = 0;
+		y += height + PADDING;
+		height = 0;
+	}
+
+	if (x + surface->w > size or y + surface->h > size)
+		return false;
+
+	*region = {x, y, surface->w, surface->h};
+
+	if (SDL_UpdateTexture(texture, region, surface->pixels, surface->pitch))
+		return false;
+
+	shelf_x = x + surface->w + PADDING;
+	shelf_y = y;
+	shelf_height = std::max(height, surface->h);
+	++regions;
+
+	return true;
+}
+
+bool AtlasPage::reuse(SDL_Surface *surface, SDL_Rect *region)
+{
+	for (size_t i = 0; i < free_regions.size(); ++i) {
+		if (free_regions[i].w != surface->w or free_regions[i].h != surface->h)
+			continue;
+
+		if (SDL_UpdateTexture(texture, &free_regions[i], surface->pixels, surface->pitch))
+			return false;
+
+		*region = free_regions[i];
+		free_regions[i] = free_regions.back();
+		free_regions.pop_back();
+		++regions;
+
+		return true;
+	}
+
+	return false;
+}
+
+void AtlasPage::release(const SDL_Rect &region)
+{
+	// tiles are all one size, streaming them in and out fills the same holes
+	free_regions.push_back(region);
+	--regions;
+}
+
+SDL_Texture *AtlasPage::getTexture()
+{
+	return texture;
+}
+
+long AtlasPage::getRegions()
+{
+	return regions;
+}
+
+TextureAtlas::TextureAtlas(Renderer *parent) :
+	parent(parent),
+	page_size(ATLAS_SIZE)
+{
+	SDL_RendererInfo info;
+
+	if (SDL_GetRendererInfo(parent->getRenderer(), &info) == 0) {
+		if (info.max_texture_width > 0)
+			page_size = std::min(page_size, info.max_texture_width);
+		if (info.max_texture_height > 0)
+			page_size = std::min(page_size, info.max_texture_height);
+	}
+}
+
+AtlasPage *TextureAtlas::insert(SDL_Surface *surface, SDL_Rect *region)
+{
+	// holes left by released images first, then room on a last shelf
+	for (auto &page : pages)
+		if (page.reuse(surface, region))
+			return &page;
+
+	for (auto &page : pages)
+		if (page.insert(surface, region))
+			return &page;
+
+	pages.emplace_back(parent, page_size);
+
+	if (pages.back().insert(surface, region))
+		return &pages.back();
+
+	pages.pop_back();
+	return nullptr;
+}
+
+void TextureAtlas::release(AtlasPage *page, const SDL_Rect &region)
+{
+	page->release(region);
+
+	// drop the page once nothing is left on it
+	if (page->getRegions() < 1)
+		pages.remove_if([page](const AtlasPage &other) {
+			return &other == page;
+		});
+}
+
+size_t TextureAtlas::getPageCount()
+{
+	return pages.size();
+}
+
+size_t TextureAtlas::getBytes()
+{
+	return pages.size() * page_size * page_size * 4;
+}
+
+// 8 bits a channel in 32 bit pixels, what the fast conversion handles
+static bool isPacked(const SDL_PixelFormat *format)
+{
+	return format->BytesPerPixel == 4 and not SDL_ISPIXELFORMAT_INDEXED(format->format) and
+	       format->Rloss == 0 and format->Gloss == 0 and format->Bloss == 0 and
+	       (format->Amask == 0 or format->Aloss == 0);
+}
+
+// colour of text in COLOR
+static SDL_Color textColor(COLOR color)
+{
+	switch (color) {
+	default:
+	case BLACK:
+		return {0, 0, 0, SDL_ALPHA_OPAQUE};
+
+	case GRAY:
+		return {169, 169, 169, SDL_ALPHA_OPAQUE};
+
+	case WHITE:
+		return {255, 255, 255, SDL_ALPHA_OPAQUE};
+
+	case RED:
+		return {255, 0, 0, SDL_ALPHA_OPAQUE};
+
+	case GREEN:
+		return {0, 255, 0, SDL_ALPHA_OPAQUE};
+
+	case BLUE:
+		return {0, 0, 255, SDL_ALPHA_OPAQUE};
+	}
+}
+
+// takes ownership, pixels are written straight into the locked texture
+static void writePixels(SDL_Surface *surface, const SDL_PixelFormat *format, void *pixels, int pitch)
+{
+	SDL_Palette *palette = surface->format->palette;
+
+	// rendered glyphs are 8 bit with a colour key, mapped without a converted copy
+	if (palette and surface->format->BytesPerPixel == 1) {
+		Uint32 lookup[256] = {};
+		Uint32 key;
+
+		for (int i = 0; i < palette->ncolors and i < 256; ++i)
+			lookup[i] = SDL_MapRGBA(format, palette->colors[i].r, palette->colors[i].g, palette->colors[i].b, SDL_ALPHA_OPAQUE);
+
+		if (SDL_GetColorKey(surface, &key) == 0 and key < 256)
+			lookup[key] = SDL_MapRGBA(format, 0, 0, 0, SDL_ALPHA_TRANSPARENT);
+
+		for (int y = 0; y < surface->h; ++y) {
+			const Uint8 *from = static_cast<const Uint8 *>(surface->pixels) + y * surface->pitch;
+			Uint32 *to = reinterpret_cast<Uint32 *>(static_cast<char *>(pixels) + y * pitch);
+
+			for (int x = 0; x < surface->w; ++x)
+				to[x] = lookup[from[x]];
+		}
+
+		SDL_FreeSurface(surface);
+		return;
+	}
+
+	surface = Texture::convertSurface(surface, format->format);
+
+	for (int y = 0; y < surface->h; ++y)
+		std::memcpy(
+			static_cast<char *>(pixels) + y * pitch,
+			static_cast<const char *>(surface->pixels) + y * surface->pitch,
+			surface->w * 4
+		);
+
+	SDL_FreeSurface(surface);
+}
+
+SDL_Surface *Texture::loadSurface(const std::filesystem::path &path, AssetCache *cache, Uint32 format)
+{
+	SDL_Surface *surface;
+	if (!path.empty() and FileSystem::exists(path)) {
+		// already decoded on an earlier run, maybe for another renderer
+		if (cache and (surface = cache->load(path))) {
+			if (surface->format->format == format)
+				return surface;
+		} else {
+			FileSystem::View file = FileSystem::open(path);
+			surface = IMG_Load_RW(SDL_RWFromConstMem(file.getData(), file.getSize()), 1);
+
+			if (!surface)
+				throw std::runtime_error(IMG_GetError());
+		}
 	} else {
-		// create missing texture
-		surface = SDL_CreateRGBSurface(
-				0, 
+		// create missing texture, in format already
+		surface = SDL_CreateRGBSurfaceWithFormat(
+				0,
 				TILE_SIZE, TILE_SIZE, 32,
-				0, 0, 0, 0
+				format
 			);
 
 		if (!surface)
 			throw std::runtime_error(SDL_GetError());
 
-		SDL_FillRect(surface, NULL, SDL_MapRGB(surface->format, 169, 169, 169));
+		SDL_FillRect(surface, NULL, SDL_MapRGB(surface->format, 169, 169, 169));
+	}
+
+	// converted once here, off the main thread, uploads take it as is
+	surface = convertSurface(surface, format);
+
+	if (cache and not path.empty())
+		cache->store(path, surface);
+
+	return surface;
+}
+
+SDL_Surface *Texture::convertSurface(SDL_Surface *surface, Uint32 format)
+{
+	if (surface->format->format == format)
+		return surface;
+
+	SDL_PixelFormat *target = SDL_AllocFormat(format);
+
+	if (not target) {
+		SDL_FreeSurface(surface);
+		throw std::runtime_error(SDL_GetError());
+	}
+
+	const SDL_PixelFormat *source = surface->format;
+	SDL_Surface *converted;
+
+	if (isPacked(source) and isPacked(target) and target->Amask and not SDL_HasColorKey(surface)) {
+		converted = SDL_CreateRGBSurfaceWithFormat(0, surface->w, surface->h, 32, format);
+
+		if (converted) {
+			// the same shifts for every pixel, compilers turn the loop into vector code
+			const int from_r = source->Rshift, from_g = source->Gshift, from_b = source->Bshift, from_a = source->Ashift;
+			const int to_r = target->Rshift, to_g = target->Gshift, to_b = target->Bshift, to_a = target->Ashift;
+			// sources without alpha are opaque
+			const Uint32 alpha = source->Amask ? 0xff : 0;
+			const Uint32 opaque = source->Amask ? 0 : target->Amask;
+
+			if (SDL_MUSTLOCK(surface))
+				SDL_LockSurface(surface);
+
+			for (int y = 0; y < surface->h; ++y) {
+				const Uint32 *from = reinterpret_cast<const Uint32 *>(static_cast<const char *>(surface->pixels) + y * surface->pitch);
+				Uint32 *to = reinterpret_cast<Uint32 *>(static_cast<char *>(converted->pixels) + y * converted->pitch);
+
+				for (int x = 0; x < surface->w; ++x) {
+					Uint32 pixel = from[x];
+
+					to[x] = ((pixel >> from_r) & 0xff) << to_r |
+					        ((pixel >> from_g) & 0xff) << to_g |
+					        ((pixel >> from_b) & 0xff) << to_b |
+					        ((pixel >> from_a) & alpha) << to_a |
+					        opaque;
+				}
+			}
+
+			if (SDL_MUSTLOCK(surface))
+				SDL_UnlockSurface(surface);
+		}
+	} else {
+		// palettes, 24 bit and colour keys
+		converted = SDL_ConvertSurfaceFormat(surface, format, 0);
+	}
+
+	SDL_FreeFormat(target);
+	SDL_FreeSurface(surface);
+
+	if (not converted)
+		throw std::runtime_error(SDL_GetError());
+
+	return converted;
+}
+
+// same size, format and rows, padding aside
+uint64_t Texture::hashSurface(SDL_Surface *surface, uint64_t *check)
+{
+	static const uint64_t OFFSET = 14695981039346656037ull;
+	static const uint64_t PRIME = 1099511628211ull;
+	// golden ratio multiply with a shift, shares nothing with FNV
+	static const uint64_t CHECK_PRIME = 0x9e3779b97f4a7c15ull;
+
+	uint64_t hash = OFFSET;
+	*check = 0;
+
+	auto mix = [&](const void *data, size_t size) {
+		const unsigned char *bytes = static_cast<const unsigned char *>(data);
+
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= PRIME;
+
+			*check = (*check + bytes[i] + 1) * CHECK_PRIME;
+			*check ^= *check >> 29;
+		}
+	};
+
+	mix(&surface->w, sizeof(surface->w));
+	mix(&surface->h, sizeof(surface->h));
+
+	if (SDL_MUSTLOCK(surface))
+		SDL_LockSurface(surface);
+
+	// rows only, pitch padding is garbage
+	for (int y = 0; y < surface->h; ++y)
+		mix(static_cast<const char *>(surface->pixels) + y * surface->pitch, surface->w * 4);
+
+	if (SDL_MUSTLOCK(surface))
+		SDL_UnlockSurface(surface);
+
+	// 0 means not hashed
+	return hash ? hash : 1;
+}
+
+Texture::Texture(Renderer *renderer, std::filesystem::path path, bool keep, TextureAtlas *atlas) :
+	Texture(renderer, path, loadSurface(path, nullptr, renderer->getFormat()->format), keep, atlas)
+{}
+
+Texture::Texture(Renderer *renderer, std::filesystem::path path, SDL_Surface *surface, bool keep, TextureAtlas *atlas) :
+	texture(nullptr),
+	page(nullptr),
+	atlas(atlas),
+	path(path),
+	color(BLACK),
+	usage(0),
+	keep(keep),
+	target(false),
+	manager(nullptr),
+	released(0),
+	last_used(0)
+{
+	// loadSurface already converted, others may not have
+	surface = convertSurface(surface, renderer->getFormat()->format);
+
+	// small images share atlas pages to cut texture binds
+	if (atlas and surface->w <= ATLAS_MAX_ITEM and surface->h <= ATLAS_MAX_ITEM)
+		page = atlas->insert(surface, &region);
+
+	if (page) {
+		texture = page->getTexture();
+	} else {
+		// same format as the surface, the driver copies without converting
+		texture = SDL_CreateTexture(
+				renderer->getRenderer(),
+				surface->format->format,
+				SDL_TEXTUREACCESS_STATIC,
+				surface->w, surface->h
+			);
+
+		if (texture and SDL_UpdateTexture(texture, NULL, surface->pixels, surface->pitch)) {
+			SDL_DestroyTexture(texture);
+			texture = nullptr;
+		}
+
+		if (texture)
+			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+		region = {0, 0, surface->w, surface->h};
+	}
+
+	SDL_FreeSurface(surface);
+
+	if (!texture)
+		throw std::runtime_error(SDL_GetError());
+
+	width = region.w;
+	height = region.h;
+}
+
+Texture::Texture(Renderer *renderer, std::string text, COLOR color, bool keep) :
+	texture(nullptr),
+	page(nullptr),
+	atlas(nullptr),
+	path(""),
+	color(color),
+	width(0),
+	height(0),
+	usage(0),
+	keep(keep),
+	target(false),
+	manager(nullptr),
+	released(0),
+	last_used(0)
+{
+	setText(renderer, text, color);
+}
+
+Texture::Texture(Renderer *renderer, int width, int height, bool keep) :
+	page(nullptr),
+	atlas(nullptr),
+	path(""),
+	color(BLACK),
+	width(width),
+	height(height),
+	usage(0),
+	keep(keep),
+	target(true),
+	manager(nullptr),
+	released(0),
+	last_used(0)
+{
+	texture = SDL_CreateTexture(
+			renderer->getRenderer(),
+			renderer->getFormat()->format,
+			SDL_TEXTUREACCESS_TARGET,
+			width, height
+		);
+
+	if (!texture)
+		throw std::runtime_error(SDL_GetError());
+
+	SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+	region = {0, 0, width, height};
+}
+
+void Texture::reload(Renderer *renderer, SDL_Surface *surface)
+{
+	// same size, the pixels go where the old ones were
+	if (page and surface->w == region.w and surface->h == region.h and
+	    surface->format->format == renderer->getFormat()->format and
+	    SDL_UpdateTexture(texture, &region, surface->pixels, surface->pitch) == 0) {
+		SDL_FreeSurface(surface);
+		return;
+	}
+
+	// built aside, takes the old texture or region with it when it goes
+	Texture fresh(renderer, path, surface, keep, atlas);
+
+	std::swap(texture, fresh.texture);
+	std::swap(page, fresh.page);
+	std::swap(region, fresh.region);
+	std::swap(width, fresh.width);
+	std::swap(height, fresh.height);
+}
+
+bool Texture::setText(Renderer *renderer, const std::string &text, COLOR color)
+{
+	SDL_Surface *surface = TTF_RenderUTF8_Solid(
+			renderer->getFont(),
+			text.c_str(),
+			textColor(color)
+		);
+
+	if (!surface)
+		throw std::runtime_error(TTF_GetError());
+
+	int size_w = surface->w;
+	int size_h = surface->h;
+
+	if (not texture) {
+		// written in place when the text changes, no new texture each time
+		texture = SDL_CreateTexture(
+				renderer->getRenderer(),
+				renderer->getFormat()->format,
+				SDL_TEXTUREACCESS_STREAMING,
+				size_w, size_h
+			);
+
+		if (!texture) {
+			SDL_FreeSurface(surface);
+			throw std::runtime_error(SDL_GetError());
+		}
+
+		SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+	} else {
+		int capacity_w, capacity_h;
+		SDL_QueryTexture(texture, NULL, NULL, &capacity_w, &capacity_h);
+
+		if (size_w > capacity_w or size_h > capacity_h) {
+			SDL_FreeSurface(surface);
+			return false;
+		}
+	}
+
+	region = {0, 0, size_w, size_h};
+	void *pixels;
+	int pitch;
+
+	if (SDL_LockTexture(texture, &region, &pixels, &pitch)) {
+		SDL_FreeSurface(surface);
+		throw std::runtime_error(SDL_GetError());
+	}
+
+	writePixels(surface, renderer->getFormat(), pixels, pitch);
+	SDL_UnlockTexture(texture);
+
+	// the rest of a bigger texture is never drawn
+	this->text = text;
+	this->color = color;
+	width = size_w;
+	height = size_h;
+
+	return true;
+}
+
+void Texture::evict()
+{
+	if (not texture)
+		return;
+
+	// pages go once all their regions are gone
+	if (page)
+		atlas->release(page, region);
+	else
+		SDL_DestroyTexture(texture);
+
+	texture = nullptr;
+	page = nullptr;
+}
+
+void Texture::restore(Renderer *renderer, AssetCache *cache)
+{
+	if (texture)
+		return;
+
+	// item sources are relative, a region elsewhere in the atlas is fine
+	Texture fresh = text.empty()
+		? Texture(renderer, path, loadSurface(path, cache, renderer->getFormat()->format), keep, atlas)
+		: Texture(renderer, text, color, keep);
+
+	std::swap(texture, fresh.texture);
+	std::swap(page, fresh.page);
+	std::swap(region, fresh.region);
+	std::swap(width, fresh.width);
+	std::swap(height, fresh.height);
+}
+
+bool Texture::isEvicted()
+{
+	return not texture;
+}
+
+size_t Texture::getBytes()
+{
+	return page or not texture ? 0 : static_cast<size_t>(width) * height * 4;
+}
+
+Texture::~Texture()
+{
+	if (page)
+		atlas->release(page, region);
+	else if (texture)
+		SDL_DestroyTexture(texture);
+}
+
+SDL_Texture *Texture::getTexture()
+{
+	return texture;
+}
+
+SDL_Rect Texture::getRegion()
+{
+	return region;
+}
+
+std::filesystem::path Texture::getPath()
+{
+	return path;
+}
+
+const std::string &Texture::getText()
+{
+	return text;
+}
+
+COLOR Texture::getColor()
+{
+	return color;
+}
+
+int Texture::getWidth()
+{
+	return width;
+}
+
+int Texture::getHeight()
+{
+	return height;
+}
+
+long Texture::addUsage()
+{
+	return ++usage;
+}
+
+long Texture::remUsage()
+{
+	// let the manager know it may be freed on next cleanup
+	if (--usage < 1 and manager)
+		manager->release(this);
+
+	return usage;
+}
+
+long Texture::getUsage()
+{
+	return usage;
+}
+
+bool Texture::isKeep()
+{
+	return keep;
+}
+
+bool Texture::isTarget()
+{
+	return target;
+}
+
+TextureHandle Texture::getHandle() const
+{
+	return handle;
+}
+
+bool Texture::operator==(const Texture &other) const
+{
+	return path == other.path;
+}
+
+TextureAccess::TextureAccess(Texture *texture) :
+	texture(texture)
+{
+	if (texture)
+		texture->addUsage();
+}
+
+TextureAccess::TextureAccess(const TextureAccess &other) :
+	texture(other.texture)
+{
+	if (texture)
+		texture->addUsage();
+}
+
+TextureAccess::~TextureAccess()
+{
+	if (texture)
+		texture->remUsage();
+}
+
+Texture *TextureAccess::operator()() const
+{
+	return texture;
+}
+
+TextureAccess &TextureAccess::operator=(const TextureAccess &other)
+{
+	if (this == &other)
+		return *this;
+
+	if (texture)
+		texture->remUsage();
+
+	texture = other.texture;
+
+	if (texture)
+		texture->addUsage();
+
+	return *this;
+}
+
+bool TextureAccess::operator==(const TextureAccess &other) const
+{
+	return texture == other.texture;
+}
+
+TextureAccess::operator TextureHandle() const
+{
+	return getHandle();
+}
+
+TextureHandle TextureAccess::getHandle() const
+{
+	if (texture)
+		return texture->getHandle();
+
+	return TextureHandle();
+}
+
+size_t TextureManager::PathHash::operator()(const std::filesystem::path &path) const
+{
+	return std::filesystem::hash_value(path);
+}
+
+TextureManager::TextureManager(Renderer *parent) :
+	parent(parent),
+	atlas(parent),
+	dedup_count(0),
+	dedup_bytes(0),
+	frame(0),
+	text_created(0),
+	watch(false),
+	budget(0),
+	texture_bytes(0),
+	target_bytes(0),
+	next_search(0),
+	evicted(0),
+	use_hits(0),
+	use_misses(0),
+	evict_count(0)
+{
+	// initialize missing texture, always slot 0
+	insert(std::make_unique<Texture>(parent, std::filesystem::path(""), true, &atlas));
+	index[internPath(std::filesystem::path(""))] = 0;
+}
+
+TextureAccess TextureManager::getMissingTexture()
+{
+	return TextureAccess(slots.front().texture.get());
+}
+
+PathId TextureManager::internPath(const std::filesystem::path &path)
+{
+	auto found = path_ids.find(path);
+	if (found != path_ids.end())
+		return found->second;
+
+	PathId id = path_names.size();
+
+	path_ids.emplace(path, id);
+	path_names.push_back(path);
+	index.push_back(NO_SLOT);
+
+	return id;
+}
+
+TextureAccess TextureManager::loadTexture(PathId path)
+{
+	if (index[path] != NO_SLOT)
+		return TextureAccess(slots[index[path]].texture.get());
+
+	return uploadTexture(path, Texture::loadSurface(path_names[path], &cache, parent->getFormat()->format));
+}
+
+TextureAccess TextureManager::loadTexture(const std::filesystem::path &path)
+{
+	return loadTexture(internPath(path));
+}
+
+std::vector<TextureAccess> TextureManager::loadTextures(const std::vector<PathId> &paths)
+{
+	std::vector<TextureAccess> result(paths.size());
+
+	// only decode what is not loaded yet
+	std::vector<size_t> pending;
+
+	for (size_t i = 0; i < paths.size(); ++i) {
+		if (index[paths[i]] != NO_SLOT)
+			result[i] = TextureAccess(slots[index[paths[i]]].texture.get());
+		else
+			pending.push_back(i);
+	}
+
+	if (pending.empty())
+		return result;
+
+	unsigned long dedup_before = dedup_count;
+	unsigned long bytes_before = dedup_bytes;
+
+	/*
+	 * workers decode images in any order,
+	 * this thread uploads them in order as they become ready
+	 * since the SDL renderer is not thread safe
+	 */
+	std::vector<SDL_Surface *> surfaces(pending.size(), nullptr);
+	std::vector<std::exception_ptr> errors(pending.size());
+	std::vector<bool> done(pending.size(), false);
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::atomic<size_t> next(0);
+	Uint32 format = parent->getFormat()->format;
+
+	auto decode = [&]() {
+		size_t i;
+
+		while ((i = next++) < pending.size()) {
+			SDL_Surface *surface = nullptr;
+			std::exception_ptr error;
+
+			try {
+				// nothing is interned while the workers run
+				surface = Texture::loadSurface(path_names[paths[pending[i]]], &cache, format);
+			} catch (...) {
+				error = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			surfaces[i] = surface;
+			errors[i] = error;
+			done[i] = true;
+			ready.notify_one();
+		}
+	};
+
+	size_t worker_count = std::max(1u, std::thread::hardware_concurrency());
+	worker_count = std::min(worker_count, pending.size());
+
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < worker_count; ++i)
+		workers.emplace_back(decode);
+
+	std::exception_ptr error;
+	size_t uploaded = 0;
+
+	for (; uploaded < pending.size(); ++uploaded) {
+		std::unique_lock<std::mutex> lock(mutex);
+		ready.wait(lock, [&]() { return done[uploaded]; });
+
+		SDL_Surface *surface = surfaces[uploaded];
+		surfaces[uploaded] = nullptr;
+
+		if (errors[uploaded]) {
+			error = errors[uploaded];
+			break;
+		}
+
+		lock.unlock();
+
+		// same path may appear more than once, upload handles that
+		try {
+			result[pending[uploaded]] = uploadTexture(paths[pending[uploaded]], surface);
+		} catch (...) {
+			error = std::current_exception();
+			break;
+		}
+	}
+
+	// stop handing out work and drop whatever was decoded for nothing
+	next = pending.size();
+
+	for (auto &worker : workers)
+		worker.join();
+
+	for (auto surface : surfaces)
+		if (surface)
+			SDL_FreeSurface(surface);
+
+	if (error)
+		std::rethrow_exception(error);
+
+	if (dedup_count != dedup_before)
+		SDL_Log(
+			"textures: %lu of %zu loaded were duplicates, %lu bytes saved",
+			dedup_count - dedup_before, pending.size(),
+			dedup_bytes - bytes_before
+		);
+
+	return result;
+}
+
+TextureAccess TextureManager::uploadTexture(PathId path, SDL_Surface *surface)
+{
+	if (index[path] != NO_SLOT) {
+		SDL_FreeSurface(surface);
+		return TextureAccess(slots[index[path]].texture.get());
+	}
+
+	/*
+	 * many tiles are copies of the same image under another name,
+	 * both hashes have to match, nothing is read again for it
+	 */
+	uint64_t hash = 0;
+	uint64_t check = 0;
+
+	// a shared texture could not follow an edit to one of its files
+	if (not watch and surface->format->format == parent->getFormat()->format) {
+		hash = Texture::hashSurface(surface, &check);
+
+		auto same = pixel_index.find(hash);
+		if (same != pixel_index.end()) {
+			SLOT &slot = slots[same->second];
+
+			if (slot.check == check) {
+				++dedup_count;
+				dedup_bytes += static_cast<unsigned long>(surface->w) * surface->h * 4;
+
+				slot.aliases.push_back(path);
+				index[path] = same->second;
+				SDL_FreeSurface(surface);
+
+				return TextureAccess(slot.texture.get());
+			}
+
+			// a collision keeps its own texture and stays out of the index
+			hash = 0;
+		}
 	}
 
-	texture = SDL_CreateTextureFromSurface(renderer->getRenderer(), surface);
+	reserve(static_cast<size_t>(surface->w) * surface->h * 4);
 
-	SDL_FreeSurface(surface);
+	TextureAccess texture = insert(std::make_unique<Texture>(parent, path_names[path], surface, false, &atlas));
+	uint32_t slot = texture.getHandle().index;
 
-	if (!texture)
-		throw std::runtime_error(SDL_GetError());
+	slots[slot].path = path;
+	index[path] = slot;
+
+	if (watch)
+		slots[slot].stamp = FileSystem::stamp(path_names[path]);
+
+	if (hash) {
+		slots[slot].hash = hash;
+		slots[slot].check = check;
+		pixel_index.emplace(hash, slot);
+	}
 
-	SDL_QueryTexture(texture, NULL, NULL, &width, &height);
+	return texture;
 }
 
-Texture::Texture(Renderer *renderer, std::string text, COLOR color, bool keep) :
-	path(""),
-	usage(0),
-	keep(keep)
+TextureAccess TextureManager::makeText(std::string text, COLOR color)
 {
-	SDL_Color color_real = {0, 0, 0};
+	std::string key = textKey(text, color);
 
-	switch (color) {
-	default:
-	case BLACK:
-		color_real = {0, 0, 0};
-		break;
+	// ui asks for the same strings every frame
+	auto found = text_index.find(key);
+	if (found != text_index.end())
+		return TextureAccess(slots[found->second].texture.get());
 
-	case GRAY:
-		color_real = {169, 169, 169};
-		break;
+	// counters change every second, an unused string big enough is written over
+	int width, height;
 
-	case WHITE:
-		color_real = {255, 255, 255};
-		break;
+	if (TTF_SizeUTF8(parent->getFont(), text.c_str(), &width, &height) == 0) {
+		for (auto it = cooling.begin(); it != cooling.end(); ++it) {
+			Texture *old = getTexture(it->first);
+			int capacity_w, capacity_h;
 
-	case RED:
-		color_real = {255, 0, 0};
-		break;
+			if (not old or old->getUsage() > 0 or old->released != it->second or old->isEvicted() or
+			    SDL_QueryTexture(old->getTexture(), NULL, NULL, &capacity_w, &capacity_h) or
+			    capacity_w < width or capacity_h < height)
+				continue;
 
-	case GREEN:
-		color_real = {0, 255, 0};
-		break;
+			// in a new slot, frames still holding the old handle draw nothing
+			std::unique_ptr<Texture> reused = take(it->first.index);
+			cooling.erase(it);
 
-	case BLUE:
-		color_real = {0, 0, 255};
-		break;
+			if (not reused->setText(parent, text, color))
+				break;
+
+			TextureAccess texture = insert(std::move(reused));
+			text_index.emplace(key, texture.getHandle().index);
+
+			return texture;
+		}
 	}
 
-	SDL_Surface *surface = TTF_RenderUTF8_Solid(
-			renderer->getFont(), 
-			text.c_str(), 
-			color_real
-		);
+	TextureAccess texture = insert(std::make_unique<Texture>(parent, text, color));
+	text_index.emplace(key, texture.getHandle().index);
+	++text_created;
 
-	if (!surface)
-		throw std::runtime_error(TTF_GetError());
+	return texture;
+}
+
+void TextureManager::cleanup()
+{
+	// unused text stays around this many cleanups
+	static const long TEXT_CACHE_FRAMES = 60;
 
-	texture = SDL_CreateTextureFromSurface(renderer->getRenderer(), surface);
+	++frame;
 
-	SDL_FreeSurface(surface);
+	for (auto handle : released) {
+		Texture *texture = getTexture(handle);
 
-	if (!texture)
-		throw std::runtime_error(SDL_GetError());
+		// gone already, used again or never to be freed
+		if (not texture or texture->getUsage() > 0 or texture->isKeep())
+			continue;
 
-	SDL_QueryTexture(texture, NULL, NULL, &width, &height);
-}
+		if (not texture->getText().empty()) {
+			texture->released = frame;
+			cooling.push_back({handle, frame});
+		} else {
+			destroy(handle.index);
+		}
+	}
 
-Texture::~Texture()
-{
-	SDL_DestroyTexture(texture);
+	released.clear();
+
+	while (not cooling.empty() and
+	       cooling.front().second + TEXT_CACHE_FRAMES < frame) {
+		auto [handle, released_frame] = cooling.front();
+		cooling.pop_front();
+
+		Texture *texture = getTexture(handle);
+
+		// a later entry exists if it was released again since
+		if (texture and texture->getUsage() < 1 and
+		    texture->released == released_frame)
+			destroy(handle.index);
+	}
+
+	reserve(0);
 }
 
-SDL_Texture *Texture::getTexture()
+void TextureManager::setWatch(bool watch)
 {
-	return texture;
+	this->watch = watch;
 }
 
-std::filesystem::path Texture::getPath()
+std::vector<std::filesystem::path> TextureManager::reloadChanged()
 {
-	return path;
+	std::vector<std::filesystem::path> changed;
+
+	if (not watch)
+		return changed;
+
+	// slot 0 is the missing texture, text and targets have no path
+	for (size_t i = 1; i < slots.size(); ++i) {
+		SLOT &slot = slots[i];
+
+		if (not slot.texture or slot.texture->getPath().empty())
+			continue;
+
+		FileStamp stamp = FileSystem::stamp(slot.texture->getPath());
+
+		if (stamp == slot.stamp)
+			continue;
+
+		slot.stamp = stamp;
+		changed.push_back(slot.texture->getPath());
+
+		// evicted ones read the new file when drawn again
+		if (slot.texture->isEvicted())
+			continue;
+
+		// a half written file decodes as the missing texture until it changes again
+		texture_bytes -= slot.texture->getBytes();
+		slot.texture->reload(parent, Texture::loadSurface(slot.texture->getPath(), &cache, parent->getFormat()->format));
+		texture_bytes += slot.texture->getBytes();
+	}
+
+	if (not changed.empty())
+		SDL_Log("textures: reloaded %zu changed files", changed.size());
+
+	return changed;
 }
 
-int Texture::getWidth()
+TextureAccess TextureManager::makeTarget(int width, int height)
 {
-	return width;
+	reserve(static_cast<size_t>(width) * height * 4);
+
+	return insert(std::make_unique<Texture>(parent, width, height));
 }
 
-int Texture::getHeight()
+Texture *TextureManager::useTexture(TextureHandle handle)
 {
-	return height;
+	Texture *texture = getTexture(handle);
+
+	if (not texture)
+		return nullptr;
+
+	texture->last_used = frame;
+
+	if (not texture->isEvicted()) {
+		++use_hits;
+		return texture;
+	}
+
+	++use_misses;
+
+	reserve(static_cast<size_t>(texture->getWidth()) * texture->getHeight() * 4);
+	texture->restore(parent, &cache);
+
+	texture_bytes += texture->getBytes();
+	--evicted;
+
+	return texture;
 }
 
-long Texture::addUsage()
+void TextureManager::setBudget(size_t bytes)
 {
-	return ++usage;
+	budget = bytes;
+	reserve(0);
 }
 
-long Texture::remUsage()
+void TextureManager::getMemoryStats(size_t *count, size_t *bytes, unsigned long *hits, unsigned long *misses, unsigned long *evictions)
 {
-	return --usage;
+	*count = getTextureCount() - evicted;
+	*bytes = texture_bytes + atlas.getBytes();
+	*hits = use_hits;
+	*misses = use_misses;
+	*evictions = evict_count;
 }
 
-long Texture::getUsage()
+Texture *TextureManager::getTexture(TextureHandle handle)
 {
-	return usage;
+	if (handle.index >= slots.size() or
+	    slots[handle.index].generation != handle.generation)
+		return nullptr;
+
+	return slots[handle.index].texture.get();
 }
 
-bool Texture::isKeep()
+size_t TextureManager::getTextureCount()
 {
-	return keep;
+	return slots.size() - free_slots.size();
 }
 
-bool Texture::operator==(const Texture &other) const
+unsigned long TextureManager::getTextCreated()
 {
-	return path == other.path;
+	return text_created;
 }
 
-TextureAccess::TextureAccess(Texture *texture) :
-	texture(texture)
+void TextureManager::getDedupStats(unsigned long *count, unsigned long *bytes)
 {
-	if (texture)
-		texture->addUsage();
+	*count = dedup_count;
+	*bytes = dedup_bytes;
 }
 
-TextureAccess::TextureAccess(const TextureAccess &other) :
-	texture(other.texture)
+AssetCache *TextureManager::getCache()
 {
-	if (texture)
-		texture->addUsage();
+	return &cache;
 }
 
-TextureAccess::~TextureAccess()
+TextureAtlas *TextureManager::getAtlas()
 {
-	if (texture)
-		texture->remUsage();
+	return &atlas;
 }
 
-Texture *TextureAccess::operator()()
+TextureAccess TextureManager::insert(std::unique_ptr<Texture> texture)
 {
-	return texture;
+	uint32_t slot;
+
+	if (not free_slots.empty()) {
+		slot = free_slots.back();
+		free_slots.pop_back();
+	} else {
+		slot = slots.size();
+		slots.push_back({nullptr, 1, 0, {}, 0, 0, {}});
+	}
+
+	texture->manager = this;
+	texture->handle = {slot, slots[slot].generation};
+	texture->last_used = frame;
+	texture_bytes += texture->getBytes();
+	if (texture->isTarget())
+		target_bytes += texture->getBytes();
+	slots[slot].texture = std::move(texture);
+
+	// ownership starts with the caller
+	return TextureAccess(slots[slot].texture.get());
 }
 
-TextureAccess &TextureAccess::operator=(const TextureAccess &other)
+void TextureManager::reserve(size_t bytes)
 {
-	if (this == &other)
-		return *this;
+	// targets are rebuilt from nothing, they cannot give anything back
+	size_t used = texture_bytes - target_bytes + atlas.getBytes();
 
-	if (texture)
-		texture->remUsage();
+	if (budget == 0 or used + bytes <= budget or frame < next_search)
+		return;
 
-	texture = other.texture;
+	// an eighth below the budget, the next uploads do not search again
+	size_t goal = budget - std::min(budget, budget / 8 + bytes);
 
-	if (texture)
-		texture->addUsage();
+	// least recent first, then own textures, then regions on the emptiest pages
+	std::vector<std::tuple<long, long, uint32_t>> candidates;
+	// at best, regions only give back whole pages
+	size_t reclaimable = 0;
 
-	return *this;
-}
+	for (uint32_t i = 1; i < slots.size(); ++i) {
+		Texture *texture = slots[i].texture.get();
 
-bool TextureAccess::operator==(const TextureAccess &other) const
-{
-	return texture == other.texture;
-}
+		// drawn lately is drawn again soon, and may still sit in a batch
+		if (not texture or texture->isKeep() or texture->isTarget() or
+		    texture->isEvicted() or texture->last_used + EVICT_MIN_FRAMES > frame)
+			continue;
 
-TextureManager::TextureManager(Renderer *parent) :
-	parent(parent)
-{
-	// initialize missing texture
-	textures.emplace_back(parent, std::filesystem::path(""), true);
+		candidates.push_back({texture->last_used, texture->page ? texture->page->getRegions() : 0, i});
+		reclaimable += static_cast<size_t>(texture->getWidth()) * texture->getHeight() * 4;
+	}
+
+	// evicting all of them would not fit, restoring them all after is the stutter
+	if (used - std::min(used, reclaimable) + bytes > budget) {
+		next_search = frame + EVICT_MIN_FRAMES;
+		return;
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+
+	for (auto [last_used, regions, slot] : candidates) {
+		if (texture_bytes - target_bytes + atlas.getBytes() <= goal)
+			break;
+
+		Texture *texture = slots[slot].texture.get();
+
+		texture_bytes -= texture->getBytes();
+		texture->evict();
+
+		++evicted;
+		++evict_count;
+	}
 }
 
-TextureAccess TextureManager::getMissingTexture()
+void TextureManager::release(Texture *texture)
 {
-	return TextureAccess(&textures.front());
+	released.push_back(texture->getHandle());
 }
 
-TextureAccess TextureManager::loadTexture(std::filesystem::path path)
+std::unique_ptr<Texture> TextureManager::take(uint32_t slot)
 {
-	for (auto it = textures.begin(); it != textures.end(); ++it)
-		if (it->getPath() == path)
-			return TextureAccess(&(*it));
+	Texture *texture = slots[slot].texture.get();
+
+	if (not texture->getText().empty()) {
+		text_index.erase(textKey(texture->getText(), texture->getColor()));
+	} else {
+		if (index[slots[slot].path] == slot)
+			index[slots[slot].path] = NO_SLOT;
+
+		for (auto it : slots[slot].aliases)
+			index[it] = NO_SLOT;
+	}
+
+	if (slots[slot].hash)
+		pixel_index.erase(slots[slot].hash);
+
+	if (texture->isEvicted())
+		--evicted;
 
-	textures.emplace_back(parent, path);
-	return TextureAccess(&textures.back());
+	texture_bytes -= texture->getBytes();
+	if (texture->isTarget())
+		target_bytes -= texture->getBytes();
+	std::unique_ptr<Texture> taken = std::move(slots[slot].texture);
+	slots[slot].path = 0;
+	slots[slot].aliases.clear();
+	slots[slot].hash = 0;
+	slots[slot].check = 0;
+	slots[slot].stamp = FileStamp();
+
+	// invalidates every handle to the old texture
+	++slots[slot].generation;
+	free_slots.push_back(slot);
+
+	taken->manager = nullptr;
+	return taken;
 }
 
-TextureAccess TextureManager::makeText(std::string text, COLOR color)
+void TextureManager::destroy(uint32_t slot)
 {
-	textures.emplace_back(parent, text, color);
-	return TextureAccess(&textures.back());
+	take(slot);
 }
 
-void TextureManager::cleanup()
+std::string TextureManager::textKey(const std::string &text, COLOR color)
 {
-	size_t size = textures.size();
-	auto it = textures.begin();
-	while (it != textures.end())
-		if (it->getUsage() < 1 and not it->isKeep())
-			it = textures.erase(it);
-		else
-			it++;
-	size = textures.size();
+	return static_cast<char>('0' + color) + text;
 }
 
-RenderItem::RenderItem(TextureAccess texture, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay) :
+RenderItem::RenderItem(const TextureAccess &texture, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay) :
+	texture(texture),
+	source(texture() ? SDL_Rect{0, 0, texture()->getWidth(), texture()->getHeight()} : SDL_Rect{0, 0, 0, 0}),
+	pos_x(pos_x),
+	pos_y(pos_y),
+	flip_vert(flip_vert),
+	flip_horz(flip_horz),
+	layer(layer),
+	overlay(overlay),
+	scale(1)
+{}
+
+RenderItem::RenderItem(TextureHandle texture, SDL_Rect source, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay) :
 	texture(texture),
+	source(source),
 	pos_x(pos_x),
 	pos_y(pos_y),
 	flip_vert(flip_vert),
 	flip_horz(flip_horz),
 	layer(layer),
-	overlay(overlay)
+	overlay(overlay),
+	scale(1)
 {}
 
 /*
@@ -271,11 +1365,16 @@ void RenderItem::setLayer(int layer)
 }
 */
 
-TextureAccess RenderItem::getTexture() const
+TextureHandle RenderItem::getTexture() const
 {
 	return texture;
 }
 
+SDL_Rect RenderItem::getSource() const
+{
+	return source;
+}
+
 int RenderItem::getX() const
 {
 	return pos_x;
@@ -306,6 +1405,16 @@ bool RenderItem::getOverlay() const
 	return overlay;
 }
 
+void RenderItem::setScale(int scale)
+{
+	this->scale = scale;
+}
+
+int RenderItem::getScale() const
+{
+	return scale;
+}
+
 auto RenderItem::operator<=>(const RenderItem &other) const
 {
 	if (layer == other.layer)
@@ -327,9 +1436,21 @@ bool RenderItem::operator>(const RenderItem &other) const
 }
 */
 
-Renderer::Renderer() :
+Renderer::Renderer(bool vsync, bool software) :
 	center_x(0),
-	center_y(0)
+	center_y(0),
+	width(0),
+	height(0),
+	scale(1),
+	frames(),
+	building(0),
+	submitted(false),
+	batch_texture(nullptr),
+	batch_width(0),
+	batch_height(0),
+	draw_count(0),
+	last_items(0),
+	last_draws(0)
 {
 	window = SDL_CreateWindow(
 	                 "Object Oriented Quest",
@@ -346,15 +1467,39 @@ Renderer::Renderer() :
 	renderer = SDL_CreateRenderer(
 	                   window,
 	                   -1,
-	                   SDL_RENDERER_ACCELERATED |
-	                   SDL_RENDERER_PRESENTVSYNC //|
-	                   //SDL_RENDERER_TARGETTEXTURE
+	                   (software ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED) |
+	                   (vsync ? SDL_RENDERER_PRESENTVSYNC : 0) |
+	                   SDL_RENDERER_TARGETTEXTURE
 	           );
 
 	if (not renderer)
 		throw std::runtime_error(SDL_GetError());
 
-	SDL_Surface *surface = IMG_Load("data/logo/WSS.png");
+	// the first packed format the renderer lists, uploads then need no conversion
+	Uint32 native = SDL_PIXELFORMAT_ARGB8888;
+	SDL_RendererInfo info;
+
+	if (SDL_GetRendererInfo(renderer, &info) == 0) {
+		for (Uint32 i = 0; i < info.num_texture_formats; ++i) {
+			Uint32 candidate = info.texture_formats[i];
+
+			if (candidate == SDL_PIXELFORMAT_ARGB8888 or candidate == SDL_PIXELFORMAT_ABGR8888 or
+			    candidate == SDL_PIXELFORMAT_RGBA8888 or candidate == SDL_PIXELFORMAT_BGRA8888) {
+				native = candidate;
+				break;
+			}
+		}
+
+		SDL_Log("renderer: %s, textures in %s", info.name, SDL_GetPixelFormatName(native));
+	}
+
+	format = SDL_AllocFormat(native);
+
+	if (not format)
+		throw std::runtime_error(SDL_GetError());
+
+	FileSystem::View icon = FileSystem::open("data/logo/WSS.png");
+	SDL_Surface *surface = IMG_Load_RW(SDL_RWFromConstMem(icon.getData(), icon.getSize()), 1);
 	if (not surface)
 		throw std::runtime_error(IMG_GetError());
 
@@ -363,7 +1508,9 @@ Renderer::Renderer() :
 
 	texture_manager = new TextureManager(this);
 
-	font = TTF_OpenFont("data/font/Hack-Regular.ttf", 10);
+	// the font reads from font_file for as long as it is open
+	font_file = FileSystem::open("data/font/Hack-Regular.ttf");
+	font = TTF_OpenFontRW(SDL_RWFromConstMem(font_file.getData(), font_file.getSize()), 1, 10);
 
 	if (not font)
 		throw std::runtime_error(TTF_GetError());
@@ -373,6 +1520,7 @@ Renderer::~Renderer()
 {
 	TTF_CloseFont(font);
 	delete texture_manager;
+	SDL_FreeFormat(format);
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 }
@@ -392,10 +1540,24 @@ TTF_Font *Renderer::getFont()
 	return font;
 }
 
+const SDL_PixelFormat *Renderer::getFormat()
+{
+	return format;
+}
+
 void Renderer::setSize(int width, int height)
 {
 	if (SDL_RenderSetLogicalSize(renderer, width, height))
 		throw std::runtime_error(SDL_GetError());
+
+	this->width = width;
+	this->height = height;
+}
+
+void Renderer::getSize(int *width, int *height)
+{
+	*width = this->width;
+	*height = this->height;
 }
 
 void Renderer::setCenter(int x, int y)
@@ -404,17 +1566,94 @@ void Renderer::setCenter(int x, int y)
 	center_y = y;
 }
 
+void Renderer::setScale(double scale)
+{
+	this->scale = scale;
+}
+
+double Renderer::getScale()
+{
+	return scale;
+}
+
+void Renderer::getView(int *x, int *y, int *w, int *h)
+{
+	// same offset present applies to non overlay items
+	*w = std::lround(width / scale);
+	*h = std::lround(height / scale);
+	*x = center_x - *w / 2;
+	*y = center_y - *h / 2;
+}
+
 void Renderer::addRenderItem(const RenderItem &item)
 {
-	render_queue.push(item);
+	++frames[building].items;
+	bucket(item.getLayer()).push_back(item);
 }
 
-void Renderer::addRenderItem(TextureAccess texture, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay)
+void Renderer::addRenderItem(const TextureAccess &texture, int pos_x, int pos_y, bool flip_vert, bool flip_horz, int layer, bool overlay)
 {
-	render_queue.emplace(texture, pos_x, pos_y, flip_vert, flip_horz, layer, overlay);
+	++frames[building].items;
+	bucket(layer).emplace_back(texture, pos_x, pos_y, flip_vert, flip_horz, layer, overlay);
 }
 
-void Renderer::operator()()
+void Renderer::renderTo(TextureAccess &target, const std::vector<RenderItem> &items, double scale)
+{
+	if (not target())
+		return;
+
+	// anything batched so far belongs to the screen
+	flushBatch();
+
+	SDL_SetRenderTarget(renderer, target()->getTexture());
+	SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0x00);
+	SDL_RenderClear(renderer);
+
+	for (auto &item : items) {
+		Texture *tex = texture_manager->useTexture(item.getTexture());
+
+		if (not tex)
+			continue;
+
+		int w = item.getSource().w * item.getScale();
+		int h = item.getSource().h * item.getScale();
+
+		SDL_Rect pos = {
+			.x = int(std::lround(item.getX() * scale)),
+			.y = int(std::lround(item.getY() * scale)),
+			.w = int(std::lround(w * scale)),
+			.h = int(std::lround(h * scale))
+		};
+
+		batchItem(tex->getTexture(), getSource(tex, item), pos, getFlip(item));
+	}
+
+	flushBatch();
+
+	// logical size of the window is restored by SDL
+	SDL_SetRenderTarget(renderer, NULL);
+}
+
+void Renderer::submit()
+{
+	FRAME &frame = frames[building];
+	frame.center_x = center_x;
+	frame.center_y = center_y;
+	frame.scale = scale;
+
+	// never drawn, dropped
+	if (submitted) {
+		for (auto &items : frames[1 - building].buckets)
+			items.clear();
+
+		frames[1 - building].items = 0;
+	}
+
+	building = 1 - building;
+	submitted = true;
+}
+
+void Renderer::present()
 {
 	int screen_width, screen_height;
 
@@ -422,41 +1661,169 @@ void Renderer::operator()()
 	SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0x00);
 	SDL_RenderClear(renderer);
 
-	while (!render_queue.empty()) {
-		auto render_item = render_queue.top();
-		auto tex = render_item.getTexture();
+	// empty unless something was submitted since the last present
+	FRAME &frame = frames[1 - building];
+
+	// layers in order, items within a layer in submission order
+	for (auto &items : frame.buckets) {
+		for (auto &render_item : items) {
+			Texture *tex = texture_manager->useTexture(render_item.getTexture());
+
+			if (not tex)
+				continue;
+
+			int w = render_item.getSource().w * render_item.getScale();
+			int h = render_item.getSource().h * render_item.getScale();
 
-		if (tex()) {
 			SDL_Rect pos;
-			if (not render_item.getOverlay())
+			if (not render_item.getOverlay()) {
+				// both edges rounded, neighbouring chunks leave no gaps
+				int left = std::lround((render_item.getX() - frame.center_x) * frame.scale);
+				int top = std::lround((render_item.getY() - frame.center_y) * frame.scale);
+				int right = std::lround((render_item.getX() + w - frame.center_x) * frame.scale);
+				int bottom = std::lround((render_item.getY() + h - frame.center_y) * frame.scale);
+
 				pos = {
-					.x = render_item.getX()
-			     	     	     - center_x + screen_width / 2,
-					.y = render_item.getY()
-			     	             - center_y + screen_height / 2,
-					.w = tex()->getWidth(),
-					.h = tex()->getHeight()
+					.x = left + screen_width / 2,
+					.y = top + screen_height / 2,
+					.w = right - left,
+					.h = bottom - top
 				};
-			else
+			} else {
 				pos = {
 					.x = render_item.getX(),
 					.y = render_item.getY(),
-					.w = tex()->getWidth(),
-					.h = tex()->getHeight()
+					.w = w,
+					.h = h
 				};
+			}
 
-			SDL_RendererFlip flip = static_cast<SDL_RendererFlip>(
-				(SDL_FLIP_VERTICAL and 
-				 render_item.getFlipVert()) |
-				(SDL_FLIP_VERTICAL and
-				 render_item.getFlipHorz())
-			);
-
-			SDL_RenderCopyEx(renderer, tex()->getTexture(), NULL, &pos, 0, NULL, flip);
+			batchItem(tex->getTexture(), getSource(tex, render_item), pos, getFlip(render_item));
 		}
 
-		render_queue.pop();
+		// keeps capacity for the next frame
+		items.clear();
 	}
 
+	flushBatch();
+
 	SDL_RenderPresent(renderer);
+
+	last_items = frame.items;
+	last_draws = draw_count;
+	frame.items = 0;
+	draw_count = 0;
+	submitted = false;
+}
+
+void Renderer::operator()()
+{
+	submit();
+	present();
+}
+
+void Renderer::getStats(int *items, int *draws)
+{
+	*items = last_items;
+	*draws = last_draws;
+}
+
+std::vector<RenderItem> &Renderer::bucket(int layer)
+{
+	if (layer < 0)
+		throw std::out_of_range("negative render layer");
+
+	// only grows the first time a layer is used
+	std::vector<std::vector<RenderItem>> &buckets = frames[building].buckets;
+
+	if (static_cast<size_t>(layer) >= buckets.size())
+		buckets.resize(layer + 1);
+
+	return buckets[layer];
+}
+
+SDL_Rect Renderer::getSource(Texture *texture, const RenderItem &item)
+{
+	// looked up now, an evicted texture may have come back elsewhere
+	SDL_Rect region = texture->getRegion();
+	SDL_Rect source = item.getSource();
+
+	source.x += region.x;
+	source.y += region.y;
+
+	return source;
+}
+
+SDL_RendererFlip Renderer::getFlip(const RenderItem &item)
+{
+	return static_cast<SDL_RendererFlip>(
+		(SDL_FLIP_VERTICAL and item.getFlipVert()) |
+		(SDL_FLIP_VERTICAL and item.getFlipHorz())
+	);
+}
+
+void Renderer::batchItem(SDL_Texture *texture, SDL_Rect source, SDL_Rect pos, SDL_RendererFlip flip)
+{
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	// consecutive items from the same atlas page share one draw call
+	if (texture != batch_texture) {
+		flushBatch();
+
+		batch_texture = texture;
+		SDL_QueryTexture(texture, NULL, NULL, &batch_width, &batch_height);
+	}
+
+	float u0 = static_cast<float>(source.x) / batch_width;
+	float v0 = static_cast<float>(source.y) / batch_height;
+	float u1 = static_cast<float>(source.x + source.w) / batch_width;
+	float v1 = static_cast<float>(source.y + source.h) / batch_height;
+
+	if (flip & SDL_FLIP_HORIZONTAL)
+		std::swap(u0, u1);
+
+	if (flip & SDL_FLIP_VERTICAL)
+		std::swap(v0, v1);
+
+	float x0 = pos.x;
+	float y0 = pos.y;
+	float x1 = pos.x + pos.w;
+	float y1 = pos.y + pos.h;
+
+	static const SDL_Color WHITE = {255, 255, 255, 255};
+	int base = vertices.size();
+
+	vertices.push_back({{x0, y0}, WHITE, {u0, v0}});
+	vertices.push_back({{x1, y0}, WHITE, {u1, v0}});
+	vertices.push_back({{x1, y1}, WHITE, {u1, v1}});
+	vertices.push_back({{x0, y1}, WHITE, {u0, v1}});
+
+	indices.push_back(base);
+	indices.push_back(base + 1);
+	indices.push_back(base + 2);
+	indices.push_back(base + 2);
+	indices.push_back(base + 3);
+	indices.push_back(base);
+#else
+	SDL_RenderCopyEx(renderer, texture, &source, &pos, 0, NULL, flip);
+	++draw_count;
+#endif
+}
+
+void Renderer::flushBatch()
+{
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	if (not vertices.empty()) {
+		SDL_RenderGeometry(
+			renderer,
+			batch_texture,
+			vertices.data(), vertices.size(),
+			indices.data(), indices.size()
+		);
+		++draw_count;
+	}
+
+	vertices.clear();
+	indices.clear();
+	batch_texture = nullptr;
+#endif
 }
@@ -1,8 +1,9 @@
 #include "ui.h"
 
+#include "vfs.h"
+
 #include <algorithm>
 #include <iomanip>
-#include <fstream>
 #include <sstream>
 
 #ifdef __unix__
@@ -29,7 +30,8 @@ UIManager::UIManager(Manager *parent) :
 	quiz_deadline(0),
 	quiz_counter(0),
 	in_menu(false),
-	in_quiz(false)
+	in_quiz(false),
+	quiz_version(0)
 {
 	// prevent input before splash screen takes over
 	game_manager->setPaused(true);
@@ -38,7 +40,7 @@ UIManager::UIManager(Manager *parent) :
 	splash = texture_manager->loadTexture("data/logo/splash.png");
 
 	// load menu and quiz animation frames
-	std::ifstream menu_frames_file("data/ui/menu/max_frame.txt");
+	std::istringstream menu_frames_file(FileSystem::read("data/ui/menu/max_frame.txt"));
 	int menu_frames;
 
 	menu_frames_file >> menu_frames;
@@ -50,7 +52,7 @@ UIManager::UIManager(Manager *parent) :
 		menu[i] = texture_manager->loadTexture(buf.str());
 	}
 
-	std::ifstream quiz_frames_file("data/ui/quiz/max_frame.txt");
+	std::istringstream quiz_frames_file(FileSystem::read("data/ui/quiz/max_frame.txt"));
 	int quiz_frames;
 
 	quiz_frames_file >> quiz_frames;
@@ -74,6 +76,7 @@ UIManager::UIManager(Manager *parent) :
 void UIManager::displayQuiz(std::string question, std::vector<std::string> answers)
 {
 	in_quiz = true;
+	++quiz_version;
 	this->question = question;
 	this->answers = answers;
 	// just in case
@@ -85,6 +88,11 @@ void UIManager::endQuiz()
 	in_quiz = false;
 }
 
+void UIManager::skipSplash()
+{
+	splash_deadline = 0;
+}
+
 void UIManager::operator()(uint64_t delta)
 {
 	tick += delta;
@@ -96,14 +104,14 @@ void UIManager::operator()(uint64_t delta)
 		renderer->addRenderItem(splash, 0, 0, false, false, 100, true);
 
 		// option to skip
-		if(input_handler->isEnter(true))
+		if(input_handler->isPressed(ACTION_ENTER))
 			splash_deadline = 0;
 
 		// do not run any other ui code during splash
 		return;
 	}
 
-	if (input_handler->isPause(true)) in_menu = not in_menu;
+	if (input_handler->isPressed(ACTION_PAUSE)) in_menu = not in_menu;
 
 	if (in_menu) {
 		// for buttons
@@ -119,9 +127,16 @@ void UIManager::operator()(uint64_t delta)
 
 			choice = 0;
 		} else {
-			// render final frame
-			renderer->addRenderItem(menu.back(), 0, 0, false, false, 10, true);
-			
+			// buttons
+			if (input_handler->isPressed(ACTION_RIGHT) and choice < 2)
+				++choice;
+
+			if (input_handler->isPressed(ACTION_LEFT) and choice > 0)
+				--choice;
+
+			if (choice < 0 or choice > 2)
+				choice = 0;
+
 			// playtime
 			uint64_t hours, minutes;
 			std::ostringstream buf;
@@ -131,60 +146,69 @@ void UIManager::operator()(uint64_t delta)
 			buf << std::setfill('0') << std::setw(2)
 			    << hours << ':' << std::setw(2) << minutes;
 
-			TextureAccess playtime_text = texture_manager->makeText(buf.str());
-			renderer->addRenderItem(playtime_text, 213, 3, false, false, 11, true);
-
-			// pickups remaining
-			TextureAccess remaining_text = texture_manager->makeText(std::to_string(game_manager->getRemaining()));
-			renderer->addRenderItem(remaining_text, 235, 18, false, false, 11, true);
-
-			// hints
-			std::list<std::string> hints = game_manager->getHints();
-			// starting height
-			int y = 46;
-
-			for (auto it : hints)
-				y = printText(it, 160, y, 26, 11) + 4;
+			std::string playtime = buf.str();
 
-			// minimap
 			// get player position
 			int player_x, player_y;
 			game_manager->getPlayer()->getMapPos(&player_x, &player_y);
 
-			/* 
-			 * scale minimap and pointer position
-			 * so that they align
-			 * dirty and hacky but time is nigh
-			 */
-			renderer->addRenderItem(minimap, -25, -3 * player_y + 119, false, false, 11, true);
-			renderer->addRenderItem(point, 3 * player_x - 29, 120, false, false, 11, true);
+			// everything the panel shows, lost targets need a rebuild too
+			std::ostringstream key;
+			key << playtime << ';' << game_manager->getRemaining() << ';'
+			    << game_manager->getHintVersion() << ';' << player_x << ','
+			    << player_y << ';' << choice << ';' << input_handler->getRenderResets();
 
-			// buttons
-			if (input_handler->isPlayer(RIGHT, true) and choice < 2)
-				++choice;
+			if (key.str() != menu_key or not menu_panel()) {
+				std::vector<RenderItem> items;
 
-			if (input_handler->isPlayer(LEFT, true) and choice > 0)
-				--choice;
+				// final frame
+				items.emplace_back(menu.back(), 0, 0, false, false, 0, true);
 
-			switch (choice) {
-			case 0:
-				renderer->addRenderItem(continue_btn, 156, 226, false, false, 11, true);
-				break;
+				TextureAccess playtime_text = texture_manager->makeText(playtime);
+				items.emplace_back(playtime_text, 213, 3, false, false, 0, true);
 
-			case 1:
-				renderer->addRenderItem(documentation_btn, 209, 226, false, false, 11, true);
-				break;
+				// pickups remaining
+				TextureAccess remaining_text = texture_manager->makeText(std::to_string(game_manager->getRemaining()));
+				items.emplace_back(remaining_text, 235, 18, false, false, 0, true);
 
-			case 2:
-				renderer->addRenderItem(exit_btn, 290, 226, false, false, 11, true);
-				break;
+				// hints
+				std::list<std::string> hints = game_manager->getHints();
+				// starting height
+				int y = 46;
 
-			default:
-				choice = 0;
-				break;
+				for (auto it : hints)
+					y = printText(items, it, 160, y, 26) + 4;
+
+				/*
+				 * minimap
+				 * scale minimap and pointer position
+				 * so that they align
+				 * dirty and hacky but time is nigh
+				 */
+				items.emplace_back(minimap, -25, -3 * player_y + 119, false, false, 0, true);
+				items.emplace_back(point, 3 * player_x - 29, 120, false, false, 0, true);
+
+				switch (choice) {
+				case 0:
+					items.emplace_back(continue_btn, 156, 226, false, false, 0, true);
+					break;
+
+				case 1:
+					items.emplace_back(documentation_btn, 209, 226, false, false, 0, true);
+					break;
+
+				case 2:
+					items.emplace_back(exit_btn, 290, 226, false, false, 0, true);
+					break;
+				}
+
+				composePanel(menu_panel, items);
+				menu_key = key.str();
 			}
 
-			if (input_handler->isEnter(true))
+			renderer->addRenderItem(menu_panel, 0, 0, false, false, 10, true);
+
+			if (input_handler->isPressed(ACTION_ENTER))
 				switch (choice) {
 				case 0:
 					in_menu = false;
@@ -222,72 +246,65 @@ void UIManager::operator()(uint64_t delta)
 
 			choice = 1;
 		} else {
-			renderer->addRenderItem(quiz.back(), 0, 0, false, false, 8, true);
-
-			// question
-			printText(question, 10, 5, 24, 9);
-
 			// answers
 			static std::vector<bool> selected(3);
-			if (input_handler->isAnswer(1, true))
+			if (input_handler->isPressed(ACTION_ANSWER_1))
 				selected[0] = not selected[0];
-			if (input_handler->isAnswer(2, true))
+			if (input_handler->isPressed(ACTION_ANSWER_2))
 				selected[1] = not selected[1];
-			if (input_handler->isAnswer(3, true))
+			if (input_handler->isPressed(ACTION_ANSWER_3))
 				selected[2] = not selected[2];
 
-			COLOR color;
-			TextureAccess digit;
+			// buttons
+			if (input_handler->isPressed(ACTION_RIGHT) and choice < 1)
+				++choice;
+
+			if (input_handler->isPressed(ACTION_LEFT) and choice > 0)
+				--choice;
 
-			if (selected[0])
-				color = GREEN;
-			else
-				color = BLACK;
+			if (choice < 0 or choice > 1)
+				choice = 1;
 
-			digit = texture_manager->makeText("1.", color);
-			renderer->addRenderItem(digit, 160, 5, false, false, 9, true);
-			printText(answers[0], 175, 5, 24, 9, color);
+			std::ostringstream key;
+			key << quiz_version << ';' << selected[0] << selected[1] << selected[2]
+			    << ';' << choice << ';' << input_handler->getRenderResets();
 
-			if (selected[1])
-				color = GREEN;
-			else
-				color = BLACK;
+			if (key.str() != quiz_key or not quiz_panel()) {
+				std::vector<RenderItem> items;
 
-			digit = texture_manager->makeText("2.", color);
-			renderer->addRenderItem(digit, 160, 80, false, false, 9, true);
-			printText(answers[1], 175, 80, 24, 9, color);
+				items.emplace_back(quiz.back(), 0, 0, false, false, 0, true);
 
-			if (selected[2])
-				color = GREEN;
-			else
-				color = BLACK;
+				// question
+				printText(items, question, 10, 5, 24);
 
-			digit = texture_manager->makeText("3.", color);
-			renderer->addRenderItem(digit, 160, 155, false, false, 9, true);
-			printText(answers[2], 175, 155, 24, 9, color);
+				// answers, selected ones in green
+				static const int ANSWER_Y[3] = {5, 80, 155};
 
-			// buttons
-			if (input_handler->isPlayer(RIGHT, true) and choice < 1)
-				++choice;
+				for (int i = 0; i < 3; ++i) {
+					COLOR color = selected[i] ? GREEN : BLACK;
 
-			if (input_handler->isPlayer(LEFT, true) and choice > 0)
-				--choice;
+					TextureAccess digit = texture_manager->makeText(std::to_string(i + 1) + ".", color);
+					items.emplace_back(digit, 160, ANSWER_Y[i], false, false, 0, true);
+					printText(items, answers[i], 175, ANSWER_Y[i], 24, color);
+				}
 
-			switch (choice) {
-			case 0:
-				renderer->addRenderItem(documentation_btn, 172, 225, false, false, 9, true);
-				break;
+				switch (choice) {
+				case 0:
+					items.emplace_back(documentation_btn, 172, 225, false, false, 0, true);
+					break;
 
-			case 1:
-				renderer->addRenderItem(submit_btn, 265, 225, false, false, 9, true);
-				break;
+				case 1:
+					items.emplace_back(submit_btn, 265, 225, false, false, 0, true);
+					break;
+				}
 
-			default:
-				choice = 1;
-				break;
+				composePanel(quiz_panel, items);
+				quiz_key = key.str();
 			}
 
-			if (input_handler->isEnter(true))
+			renderer->addRenderItem(quiz_panel, 0, 0, false, false, 8, true);
+
+			if (input_handler->isPressed(ACTION_ENTER))
 				switch (choice) {
 				case 0:
 					openDocumentation();
@@ -311,7 +328,7 @@ void UIManager::operator()(uint64_t delta)
 	game_manager->setPaused(in_menu or in_quiz);
 }
 
-int UIManager::printText(std::string text, int x, int y, int max_char, int layer, COLOR color)
+int UIManager::printText(std::vector<RenderItem> &items, std::string text, int x, int y, int max_char, COLOR color)
 {
 	/*
 	 * function to print text with wrapping
@@ -326,7 +343,7 @@ int UIManager::printText(std::string text, int x, int y, int max_char, int layer
 	while (end < text.size()) {
 		if (text[end] == ';' or end - begin + 1 >= max_char) {
 			TextureAccess text_part = texture_manager->makeText(text.substr(begin, end - begin), color);
-			renderer->addRenderItem(text_part, x, y, false, false, layer, true);
+			items.emplace_back(text_part, x, y, false, false, 0, true);
 
 			begin = end;
 			y += SPACING;
@@ -342,7 +359,7 @@ int UIManager::printText(std::string text, int x, int y, int max_char, int layer
 
 	// print last part
 	TextureAccess text_part = texture_manager->makeText(text.substr(begin), color);
-	renderer->addRenderItem(text_part, x, y, false, false, layer, true);
+	items.emplace_back(text_part, x, y, false, false, 0, true);
 
 	y += SPACING;
 
@@ -350,6 +367,18 @@ int UIManager::printText(std::string text, int x, int y, int max_char, int layer
 	return y;
 }
 
+void UIManager::composePanel(TextureAccess &panel, const std::vector<RenderItem> &items)
+{
+	// panels cover the whole logical screen, whatever the zoom
+	int view_w, view_h;
+	renderer->getSize(&view_w, &view_h);
+
+	if (not panel() or panel()->getWidth() != view_w or panel()->getHeight() != view_h)
+		panel = texture_manager->makeTarget(view_w, view_h);
+
+	renderer->renderTo(panel, items);
+}
+
 void UIManager::openDocumentation()
 {
 	static std::filesystem::path course("data/course.pdf");
@@ -0,0 +1,304 @@
+#include "vfs.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#if _WIN32
+#include <ciso646>
+#endif
+
+static const char MAGIC[4] = {'O', 'O', 'Q', 'P'};
+
+struct ENTRY {
+	uint64_t offset;
+	uint64_t size;
+	int64_t mtime;
+};
+
+// set once by mount, read only afterwards
+static std::unique_ptr<MappedFile> archive;
+static std::unordered_map<std::string_view, ENTRY> entries;
+static int64_t archive_mtime;
+
+template <typename T>
+static T readValue(const char *data, size_t size, size_t *offset)
+{
+	T value;
+
+	if (*offset + sizeof(value) > size)
+		throw std::runtime_error("archive truncated");
+
+	std::memcpy(&value, data + *offset, sizeof(value));
+	*offset += sizeof(value);
+
+	return value;
+}
+
+template <typename T>
+static void append(std::vector<char> &buffer, const T &value)
+{
+	const char *bytes = reinterpret_cast<const char *>(&value);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+static bool isLoose(const std::filesystem::path &path)
+{
+	std::error_code error;
+	return std::filesystem::is_regular_file(path, error);
+}
+
+// archive entry for a data/ path, nullptr if none
+static const ENTRY *find(const std::filesystem::path &path)
+{
+	if (not archive)
+		return nullptr;
+
+	std::string key = path.lexically_normal().generic_string();
+	std::string_view prefix = ARCHIVE_ROOT "/";
+
+	if (key.compare(0, prefix.size(), prefix) != 0)
+		return nullptr;
+
+	auto found = entries.find(std::string_view(key).substr(prefix.size()));
+
+	return found == entries.end() ? nullptr : &found->second;
+}
+
+FileSystem::View::View() :
+	data(nullptr),
+	size(0)
+{}
+
+FileSystem::View::View(const char *data, size_t size) :
+	data(data),
+	size(size)
+{}
+
+FileSystem::View::View(const std::filesystem::path &path) :
+	file(std::make_unique<MappedFile>(path))
+{
+	data = file->getData();
+	size = file->getSize();
+}
+
+const char *FileSystem::View::getData() const
+{
+	return data;
+}
+
+size_t FileSystem::View::getSize() const
+{
+	return size;
+}
+
+void FileSystem::mount(const std::filesystem::path &path)
+{
+	unmount();
+
+	std::error_code error;
+
+	if (not std::filesystem::exists(path, error))
+		return;
+
+	archive = std::make_unique<MappedFile>(path);
+	archive_mtime = std::filesystem::last_write_time(path).time_since_epoch().count();
+
+	const char *data = archive->getData();
+	size_t size = archive->getSize();
+
+	try {
+		ArchiveHeader header;
+
+		if (not data or size < sizeof(header))
+			throw std::runtime_error("archive truncated");
+
+		std::memcpy(&header, data, sizeof(header));
+
+		if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+			throw std::runtime_error("not an archive: " + path.string());
+
+		if (header.version != ARCHIVE_VERSION)
+			throw std::runtime_error("unsupported archive version, rerun ooq-pack");
+
+		if (header.size != size or sizeof(header) + header.index_size > size)
+			throw std::runtime_error("archive truncated");
+
+		size_t offset = sizeof(header);
+		size_t index_end = offset + header.index_size;
+
+		entries.reserve(header.count);
+
+		for (uint32_t i = 0; i < header.count; ++i) {
+			ENTRY entry;
+			entry.offset = readValue<uint64_t>(data, index_end, &offset);
+			entry.size = readValue<uint64_t>(data, index_end, &offset);
+			entry.mtime = readValue<int64_t>(data, index_end, &offset);
+
+			uint16_t length = readValue<uint16_t>(data, index_end, &offset);
+
+			if (offset + length > index_end or entry.offset > size or entry.size > size - entry.offset)
+				throw std::runtime_error("archive corrupted");
+
+			// keys point into the mapping
+			entries.emplace(std::string_view(data + offset, length), entry);
+			offset += length;
+		}
+	} catch (...) {
+		unmount();
+		throw;
+	}
+}
+
+void FileSystem::unmount()
+{
+	entries.clear();
+	archive.reset();
+}
+
+bool FileSystem::isMounted()
+{
+	return archive != nullptr;
+}
+
+bool FileSystem::exists(const std::filesystem::path &path)
+{
+	return isLoose(path) or find(path);
+}
+
+bool FileSystem::stat(const std::filesystem::path &path, int64_t *mtime, uint64_t *size)
+{
+	std::error_code error;
+
+	if (isLoose(path)) {
+		auto time = std::filesystem::last_write_time(path, error);
+		if (error)
+			return false;
+
+		*size = std::filesystem::file_size(path, error);
+		if (error)
+			return false;
+
+		*mtime = time.time_since_epoch().count();
+
+		return true;
+	}
+
+	const ENTRY *entry = find(path);
+
+	if (not entry)
+		return false;
+
+	// a repack changes what the file was built from
+	*mtime = entry->mtime ^ archive_mtime;
+	*size = entry->size;
+
+	return true;
+}
+
+FileStamp FileSystem::stamp(const std::filesystem::path &path)
+{
+	FileStamp result;
+	result.exists = stat(path, &result.mtime, &result.size);
+
+	return result;
+}
+
+FileSystem::View FileSystem::open(const std::filesystem::path &path)
+{
+	if (isLoose(path))
+		return View(path);
+
+	const ENTRY *entry = find(path);
+
+	if (not entry)
+		throw std::runtime_error("cannot open " + path.string());
+
+	return View(entry->size ? archive->getData() + entry->offset : nullptr, entry->size);
+}
+
+std::string FileSystem::read(const std::filesystem::path &path)
+{
+	View view = open(path);
+
+	return view.getData() ? std::string(view.getData(), view.getSize()) : std::string();
+}
+
+void FileSystem::pack(const std::filesystem::path &root, const std::filesystem::path &output)
+{
+	struct SOURCE {
+		std::filesystem::path path;
+		std::string name;
+	};
+
+	std::vector<SOURCE> files;
+
+	for (auto &it : std::filesystem::recursive_directory_iterator(root)) {
+		if (not it.is_regular_file())
+			continue;
+
+		std::string name = it.path().lexically_relative(root).generic_string();
+
+		if (name.size() > UINT16_MAX)
+			throw std::runtime_error("path too long: " + name);
+
+		files.push_back({it.path(), name});
+	}
+
+	// same input, same archive
+	std::sort(files.begin(), files.end(), [](const SOURCE &a, const SOURCE &b) {
+		return a.name < b.name;
+	});
+
+	std::vector<char> index;
+	std::vector<char> contents;
+
+	size_t index_size = 0;
+	for (auto &it : files)
+		index_size += 3 * sizeof(uint64_t) + sizeof(uint16_t) + it.name.size();
+
+	// contents start aligned, compiled maps are read in place
+	size_t base = (sizeof(ArchiveHeader) + index_size + 7) / 8 * 8;
+
+	for (auto &it : files) {
+		std::ifstream file(it.path, std::ios::binary);
+		std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		if (file.bad())
+			throw std::runtime_error("cannot read " + it.path.string());
+
+		contents.resize((contents.size() + 7) / 8 * 8, 0);
+
+		append(index, uint64_t(base + contents.size()));
+		append(index, uint64_t(bytes.size()));
+		append(index, int64_t(std::filesystem::last_write_time(it.path).time_since_epoch().count()));
+		append(index, uint16_t(it.name.size()));
+		index.insert(index.end(), it.name.begin(), it.name.end());
+
+		contents.insert(contents.end(), bytes.begin(), bytes.end());
+	}
+
+	ArchiveHeader header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = ARCHIVE_VERSION;
+	header.count = files.size();
+	header.index_size = index.size();
+	header.size = base + contents.size();
+
+	std::vector<char> padding(base - sizeof(header) - index.size(), 0);
+	std::ofstream file(output, std::ios::binary | std::ios::trunc);
+
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(index.data(), index.size());
+	file.write(padding.data(), padding.size());
+	file.write(contents.data(), contents.size());
+
+	if (not file)
+		throw std::runtime_error("cannot write " + output.string());
+}
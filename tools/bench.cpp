@@ -0,0 +1,243 @@
+/*
+ * OOQ_bench, runs the game headless and reports timings
+ *
+ * usage: OOQ_bench [script] [game options]
+ * default script is data/bench/walk_poli.txt
+ *
+ * scripts are lines of
+ *   map <id>             map to play, before any input
+ *   <frame> down <key>   key names as SDL_GetKeyFromName takes them
+ *   <frame> up <key>
+ *   <frame> end          last frame to run
+ * lines starting with # are ignored, OOQ --record writes these too
+ *
+ * every frame advances the game by exactly REPLAY_FRAME_TIME,
+ * so runs play out the same however long frames take
+ */
+
+#include "manager.h"
+#include "mapfile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __unix__
+#include <SDL2/SDL.h>
+#elif _WIN32
+#include <ciso646>
+#include <SDL.h>
+#else
+#error Unsupported platform
+#endif
+
+struct EVENT {
+	uint64_t frame;
+	bool down;
+	SDL_Keycode key;
+};
+
+struct SCRIPT {
+	int map = -1;
+	uint64_t end = 0;
+	std::vector<EVENT> events;
+};
+
+static SCRIPT readScript(const std::filesystem::path &path)
+{
+	std::ifstream file(path);
+
+	if (not file)
+		throw std::runtime_error("cannot open " + path.string());
+
+	SCRIPT script;
+	std::string line;
+
+	while (std::getline(file, line)) {
+		std::istringstream data(line);
+		std::string first, action, key;
+
+		if (not (data >> first) or first[0] == '#')
+			continue;
+
+		if (first == "map") {
+			data >> script.map;
+			continue;
+		}
+
+		uint64_t frame = std::stoull(first);
+		data >> action;
+
+		if (action == "end") {
+			script.end = frame;
+			continue;
+		}
+
+		data >> key;
+		SDL_Keycode code = SDL_GetKeyFromName(key.c_str());
+
+		if ((action != "down" and action != "up") or code == SDLK_UNKNOWN)
+			throw std::runtime_error("bad line in " + path.string() + ": " + line);
+
+		script.events.push_back({frame, action == "down", code});
+		script.end = std::max(script.end, frame);
+	}
+
+	// replay in frame order, keeping file order within a frame
+	std::stable_sort(script.events.begin(), script.events.end(),
+	                 [](const EVENT &a, const EVENT &b) {
+		return a.frame < b.frame;
+	});
+
+	return script;
+}
+
+static void pushKey(const EVENT &event)
+{
+	SDL_Event key = {};
+
+	key.type = event.down ? SDL_KEYDOWN : SDL_KEYUP;
+	key.key.keysym.sym = event.key;
+	key.key.keysym.scancode = SDL_GetScancodeFromKey(event.key);
+	key.key.state = event.down ? SDL_PRESSED : SDL_RELEASED;
+
+	SDL_PushEvent(&key);
+}
+
+static double millis(uint64_t counts)
+{
+	return counts * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// nearest rank, times must be sorted
+static double percentile(const std::vector<double> &times, double p)
+{
+	if (times.empty())
+		return 0;
+
+	size_t rank = std::ceil(p * times.size());
+	return times[std::clamp<size_t>(rank, 1, times.size()) - 1];
+}
+
+int main(int argc, char **argv)
+{
+	std::filesystem::path script_path = "data/bench/walk_poli.txt";
+
+	// the rest goes to the game, it ignores what it does not know
+	std::vector<char *> args = {argv[0]};
+	for (int i = 1; i < argc; ++i) {
+		if (i == 1 and argv[i][0] != '-')
+			script_path = argv[i];
+		else
+			args.push_back(argv[i]);
+	}
+
+	static char uncapped[] = "--uncapped";
+	static char software[] = "--software";
+	args.push_back(uncapped);
+	args.push_back(software);
+
+	// no window, SDL_VIDEODRIVER in the environment still wins
+	SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+
+	try {
+		SCRIPT script = readScript(script_path);
+		std::cout << std::fixed << std::setprecision(2);
+
+		Manager manager(args.size(), args.data());
+		MapManager *map_manager = manager.getGameManager()->getMapManager();
+		TextureManager *texture_manager = manager.getRenderer()->getTextureManager();
+
+		manager.getUIManager()->skipSplash();
+
+		// cold loads, textures of the previous map are freed in between
+		std::vector<std::filesystem::path> maps = readMapList("data/maps.txt");
+
+		for (size_t i = 0; i < maps.size(); ++i) {
+			if (maps[i].empty())
+				continue;
+
+			uint64_t start = SDL_GetPerformanceCounter();
+			map_manager->loadMap(i);
+			uint64_t end = SDL_GetPerformanceCounter();
+
+			std::cout << "load " << maps[i].string() << ": "
+			          << millis(end - start) << " ms\n";
+
+			texture_manager->cleanup();
+		}
+
+		if (script.map >= 0)
+			map_manager->loadMap(script.map, true);
+
+		std::vector<double> times;
+		times.reserve(script.end + 1);
+
+		// should stay flat however far the script walks
+		TextureAtlas *atlas = texture_manager->getAtlas();
+		size_t pages_start = atlas->getPageCount();
+		size_t pages_max = pages_start;
+
+		size_t next = 0;
+
+		for (uint64_t frame = 0; frame <= script.end and not manager.isQuit(); ++frame) {
+			for (; next < script.events.size() and script.events[next].frame == frame; ++next)
+				pushKey(script.events[next]);
+
+			uint64_t start = SDL_GetPerformanceCounter();
+			manager.runFrame(REPLAY_FRAME_TIME);
+			uint64_t end = SDL_GetPerformanceCounter();
+
+			times.push_back(millis(end - start));
+			pages_max = std::max(pages_max, atlas->getPageCount());
+		}
+
+		double total = 0;
+		for (auto it : times)
+			total += it;
+
+		std::sort(times.begin(), times.end());
+
+		std::cout << "frames: " << times.size() << '\n'
+		          << "frame p50: " << percentile(times, 0.50) << " ms\n"
+		          << "frame p99: " << percentile(times, 0.99) << " ms\n"
+		          << "frame max: " << (times.empty() ? 0 : times.back()) << " ms\n"
+		          << "frame avg: " << (times.empty() ? 0 : total / times.size()) << " ms\n";
+
+		unsigned long dedup_count, dedup_bytes;
+		texture_manager->getDedupStats(&dedup_count, &dedup_bytes);
+
+		std::cout << "duplicate textures: " << dedup_count
+		          << " (" << dedup_bytes / 1024 << " KiB not uploaded)\n";
+
+		unsigned long cache_hits, cache_misses;
+		texture_manager->getCache()->getStats(&cache_hits, &cache_misses);
+
+		std::cout << "asset cache: " << cache_hits << " hits, "
+		          << cache_misses << " misses\n";
+
+		size_t resident, bytes;
+		unsigned long hits, misses, evictions;
+		texture_manager->getMemoryStats(&resident, &bytes, &hits, &misses, &evictions);
+
+		std::cout << "texture memory: " << resident << " textures, "
+		          << bytes / 1024 << " KiB, " << evictions << " evictions, "
+		          << misses << " restored of " << hits + misses << " draws\n";
+
+		std::cout << "atlas pages: " << pages_start << " at start, "
+		          << pages_max << " at most, "
+		          << atlas->getPageCount() << " at end\n";
+	} catch (const std::exception &e) {
+		std::cerr << "OOQ_bench: " << e.what() << '\n';
+		return 1;
+	}
+
+	return 0;
+}
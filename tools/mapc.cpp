@@ -0,0 +1,39 @@
+/*
+ * ooq-mapc, compiles text maps into the binary map format
+ *
+ * usage: ooq-mapc [maps.txt]
+ * every map listed is written next to its source as .ooqm
+ */
+
+#include "mapfile.h"
+
+#include <exception>
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+	std::filesystem::path list = argc > 1 ? argv[1] : "data/maps.txt";
+
+	try {
+		for (auto &source : readMapList(list)) {
+			if (source.empty())
+				continue;
+
+			std::filesystem::path compiled = source;
+			compiled.replace_extension(MAP_EXTENSION);
+
+			MapData map = readMapText(source);
+			writeMapFile(compiled, map);
+
+			std::cout << source.string() << " -> " << compiled.string()
+			          << " (" << map.width << 'x' << map.height << ", "
+			          << map.tiles.size() << " tiles, "
+			          << map.objects.size() << " objects)\n";
+		}
+	} catch (const std::exception &e) {
+		std::cerr << "ooq-mapc: " << e.what() << '\n';
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * ooq-pack, packs data/ into one archive
+ *
+ * usage: ooq-pack [data] [data.ooqp]
+ * run after ooq-mapc so the compiled maps go in too
+ */
+
+#include "vfs.h"
+
+#include <exception>
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+	std::filesystem::path root = argc > 1 ? argv[1] : ARCHIVE_ROOT;
+	std::filesystem::path output = argc > 2 ? argv[2] : ARCHIVE_PATH;
+
+	try {
+		FileSystem::pack(root, output);
+
+		// read it back the way the game does
+		FileSystem::mount(output);
+
+		std::cout << root.string() << " -> " << output.string()
+		          << " (" << std::filesystem::file_size(output) / 1024 << " KiB)\n";
+	} catch (const std::exception &e) {
+		std::cerr << "ooq-pack: " << e.what() << '\n';
+		return 1;
+	}
+
+	return 0;
+}